@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  pinprocbench.cpp
+ *  libpinproc
+ *
+ *  Measures the host side of the receive path against the simulator, so it
+ *  runs anywhere and needs no board.  Each round schedules a burst of
+ *  events, lets the simulator emit them, then times the two halves of the
+ *  work separately:
+ *
+ *    sort    PRWaitForEvents(h, 0), until the round is in: reads the
+ *            transport and sorts words into the event queue.
+ *    decode  PRGetEvents(): turns the queued words into PREvent structs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "pinproc.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const int eventsPerRound = 4096; // The simulator queues at most 64 KB of unread data.
+
+static double ElapsedNs(Clock::time_point start)
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-n events] [-m accel|dmd|mixed]\n", name);
+    fprintf(stderr, "  -n  Total number of events to push through (default 1000000).\n");
+    fprintf(stderr, "  -m  Event mix: accelerometer streaming on all four axes (default),\n");
+    fprintf(stderr, "      DMD frame events, or both interleaved.\n");
+}
+
+int main(int argc, char **argv)
+{
+    long totalEvents = 1000000;
+    const char *mix = "accel";
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            totalEvents = atol(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            mix = argv[++i];
+        else
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    bool accel = strcmp(mix, "dmd") != 0;
+    bool dmd = strcmp(mix, "accel") != 0;
+    if (totalEvents <= 0 || (strcmp(mix, "accel") != 0 && strcmp(mix, "dmd") != 0 && strcmp(mix, "mixed") != 0))
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    PRCreateOptions options;
+    PRCreateOptionsInit(&options);
+    options.transportType = kPRTransportSimulator;
+    options.simulatorChipID = P3_ROC_CHIP_ID;
+    options.eventQueueSize = eventsPerRound;
+
+    PRHandle proc = PRCreateEx(kPRMachinePDB, &options);
+    if (proc == kPRHandleInvalid)
+    {
+        fprintf(stderr, "Error creating simulator handle: %s\n", PRGetLastErrorText());
+        return 1;
+    }
+
+    std::vector<PRSimulatorEvent> script(eventsPerRound);
+    std::vector<PREvent> events(eventsPerRound);
+    double sortNs = 0, decodeNs = 0;
+    long received = 0, rounds = 0;
+    uint64_t now = 0;
+    uint32_t seed = 12345;
+
+    while (received < totalEvents)
+    {
+        // Axes, values and (for the mix) event types come from a xorshift
+        // generator so the order is as unpredictable as a real stream.
+        for (int i = 0; i < eventsPerRound; i++)
+        {
+            PRSimulatorEvent *e = &script[i];
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            e->time = now + 1;
+            if (accel && (!dmd || (seed & 0x10000)))
+            {
+                e->type = kPRSimulatorEventAccelerometer;
+                e->number = seed & 3;
+                e->value = (uint16_t)((seed >> 2) & 0x3FFF);
+            }
+            else
+            {
+                e->type = kPRSimulatorEventDMDFrame;
+                e->number = seed & 3;
+                e->value = 0;
+            }
+        }
+        PRSimulatorScheduleEvents(proc, &script[0], eventsPerRound);
+        PRSimulatorAdvance(proc, 1);
+        now++;
+
+        // Each pass reads at most one receive buffer's worth, so keep going
+        // until the whole round has been sorted.
+        Clock::time_point start = Clock::now();
+        int ready = 0, previous = -1;
+        while (ready < eventsPerRound && ready != previous)
+        {
+            previous = ready;
+            ready = PRWaitForEvents(proc, 0);
+        }
+        sortNs += ElapsedNs(start);
+
+        start = Clock::now();
+        int n = PRGetEvents(proc, &events[0], eventsPerRound);
+        decodeNs += ElapsedNs(start);
+
+        if (ready != eventsPerRound || n != eventsPerRound)
+        {
+            fprintf(stderr, "Round %ld: expected %d events, %d were ready and %d returned\n", rounds, eventsPerRound, ready, n);
+            PRDelete(proc);
+            return 1;
+        }
+        received += n;
+        rounds++;
+    }
+
+    PRStats stats;
+    PRGetStats(proc, &stats);
+    PRDelete(proc);
+
+    printf("%ld %s events in %ld rounds of %d (%llu dropped)\n", received, mix, rounds, eventsPerRound, (unsigned long long)stats.eventsDropped);
+    printf("  sort:   %7.2f ns/event  %8.1f Mevents/s\n", sortNs / received, received / sortNs * 1000.0);
+    printf("  decode: %7.2f ns/event  %8.1f Mevents/s\n", decodeNs / received, received / decodeNs * 1000.0);
+    return 0;
+}
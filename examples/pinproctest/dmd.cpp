@@ -27,8 +27,6 @@
 
 void ConfigureDMD(PRHandle proc)
 {
-    int i;
-    
     // Create the structure that holds the DMD settings
     PRDMDConfig dmdConfig;
     memset(&dmdConfig, 0x0, sizeof(dmdConfig));
@@ -40,17 +38,13 @@ void ConfigureDMD(PRHandle proc)
     dmdConfig.autoIncBufferWrPtr = true;
     dmdConfig.enableFrameEvents = true;
     
-    for (i = 0; i < kDMDSubFrames; i++)
-    {
-        dmdConfig.rclkLowCycles[i] = 15;
-        dmdConfig.latchHighCycles[i] = 15;
-        dmdConfig.dotclkHalfPeriod[i] = 1;
-    }
-    
-    dmdConfig.deHighCycles[0] = 250;
-    dmdConfig.deHighCycles[1] = 400;
-    dmdConfig.deHighCycles[2] = 180;
-    dmdConfig.deHighCycles[3] = 800;
+    // Pick deHighCycles for evenly spaced brightness levels at a
+    // flicker-free refresh rate.
+    PRDMDTiming dmdTiming;
+    if (PRDMDComputeTiming(&dmdConfig, kDMDRefreshHz, 0, &dmdTiming) != kPRSuccess)
+        printf("DMD timing: %s\n", PRGetLastErrorText());
+    printf("DMD refreshes at %d.%03d Hz with %d brightness levels.\n",
+           dmdTiming.frameRateMilliHz / 1000, dmdTiming.frameRateMilliHz % 1000, dmdTiming.numLevels);
     
     PRDMDUpdateConfig(proc, &dmdConfig);
 }
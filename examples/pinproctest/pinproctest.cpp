@@ -254,11 +254,8 @@ void RunLoop(PRHandle proc)
             }
         }
         PRFlushWriteData(proc);
-#ifdef _MSC_VER
-        Sleep(10);
-#else
-        usleep(10*1000); // Sleep for 10ms so we aren't pegging the CPU.
-#endif
+        // Wake as soon as new events arrive; the 10ms timeout keeps the watchdog tickled.
+        PRWaitForEvents(proc, 10*1000);
     }
 }
 
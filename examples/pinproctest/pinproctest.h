@@ -68,6 +68,7 @@
 #define kDMDRows (32)
 #define kDMDSubFrames (4) // For color depth of 16
 #define kDMDFrameBuffers (3) // 3 is the max
+#define kDMDRefreshHz (240) // Full frames, all subframes, per second
 
 void ConfigureDrivers(PRHandle proc);
 
@@ -369,9 +369,49 @@ typedef enum PRMachineType {
     kPRMachinePDB = 7,                  // PinballControllers.com Driver Boards
 } PRMachineType;
 
+/** Selects how a #PRHandle talks to its board.  See PRCreateEx(). */
+typedef enum PRTransportType {
+    kPRTransportFTDI = 0,   /**< USB through libftdi (D2xx on Windows).  This is what PRCreate() uses. */
+    kPRTransportMemory = 1, /**< In-process loopback with no hardware attached.  Writes are stored in a register image and read requests are answered from it. */
+    kPRTransportSimulator = 2, /**< In-process model of the FPGA: switches, switch rules, drivers and the DMD respond as on a board.  See @ref simulator. */
+} PRTransportType;
+
+typedef struct PRCreateOptions {
+    PRTransportType transportType;
+    uint32_t deviceIndex;   /**< Which board to open when several are attached, counting FT245RL boards first, then FT240X (#kPRTransportFTDI only). */
+    uint32_t simulatorChipID; /**< #P_ROC_CHIP_ID or #P3_ROC_CHIP_ID; selects the register map the simulator models (#kPRTransportSimulator only). */
+    /**
+     * If true, the handle gets a background thread that owns the transport.
+     * Writes are queued to it through a lock-free ring and it decodes incoming events into another,
+     * so PRFlushWriteData() and PRGetEvents() never wait on USB.
+     * All API calls on the handle must still come from a single application thread.
+     */
+    bool_t useIOThread;
+    /**
+     * Capacity of the handle's event queue, rounded up to a power of two.
+     * Events that arrive while it is full are dropped and counted in PRStats.eventsDropped.
+     */
+    uint32_t eventQueueSize;
+    /**
+     * Capacity in words of the queue holding responses to PRReadData() and friends, rounded up to a power of two.
+     * Never less than 2048, the longest response the device can send.
+     */
+    uint32_t requestedDataQueueSize;
+} PRCreateOptions;
+
+#define kPRDefaultEventQueueSize (4096)         /**< PRCreateOptions.eventQueueSize set by PRCreateOptionsInit(). */
+#define kPRDefaultRequestedDataQueueSize (4096) /**< PRCreateOptions.requestedDataQueueSize set by PRCreateOptionsInit(). */
+
 // PRHandle Creation and Deletion
 
 PINPROC_API PRHandle PRCreate(PRMachineType machineType); /**< Create a new P-ROC device handle.  Only one handle per device may be created. This handle must be destroyed with PRDelete() when it is no longer needed.  Returns #kPRHandleInvalid if an error occurred. */
+PINPROC_API void PRCreateOptionsInit(PRCreateOptions *options); /**< Fills in the options PRCreate() uses. */
+/**
+ * @brief Creates a new device handle using the given options.
+ * Each handle owns its own transport, so several handles (one per board) may be open at once.
+ * With #kPRTransportMemory the machine type is not checked against the board's settings since there is no board.
+ */
+PINPROC_API PRHandle PRCreateEx(PRMachineType machineType, PRCreateOptions *options);
 PINPROC_API void PRDelete(PRHandle handle);               /**< Destroys an existing P-ROC device handle. */
 
 #define kPRResetFlagDefault (0) /**< Only resets state in memory and does not write changes to the device. */
@@ -396,9 +436,65 @@ PINPROC_API PRResult PRWriteData(PRHandle handle, uint32_t moduleSelect, uint32_
 /** Write data buffered to P-ROC (does require a call to PRFlushWriteData). */
 PINPROC_API PRResult PRWriteDataUnbuffered(PRHandle handle, uint32_t moduleSelect, uint32_t startingAddr, int32_t numWriteWords, uint32_t * writeBuffer);
 
-/** Read data from the P-ROC. */
+/**
+ * Read data from the P-ROC.
+ * Any buffered write data goes out in the same USB transfer as the read request, ahead of it,
+ * so the read sees the result of every write made before it.
+ */
 PINPROC_API PRResult PRReadData(PRHandle handle, uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, uint32_t * readBuffer);
 
+/**
+ * @brief Like PRReadData(), but waits at most timeoutUs microseconds for the reply.
+ * Returns as soon as the reply has arrived.  The first 200 us are spent polling the device flat out;
+ * after that the wait sleeps in steps that grow to 1 ms.  PRReadData() waits in the same way for up to 100 ms.
+ */
+PINPROC_API PRResult PRReadDataTimeout(PRHandle handle, uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, uint32_t * readBuffer, uint32_t timeoutUs);
+
+/** One block of registers to read with PRReadDataMulti(). */
+typedef struct PRReadRequest {
+    uint32_t moduleSelect;
+    uint32_t startingAddr;
+    int32_t numWords;   /**< 1 to 2047. */
+    uint32_t * dest;    /**< Receives numWords words. */
+} PRReadRequest;
+
+/**
+ * @brief Reads several blocks of registers in one round trip.
+ * All of the read requests go out in a single USB write and the call returns once every reply has arrived,
+ * so a batch costs about the same as a single PRReadData().  Fails if any of the reads fails; the contents of
+ * the dest buffers are then undefined.
+ */
+PINPROC_API PRResult PRReadDataMulti(PRHandle handle, PRReadRequest * requests, int32_t numRequests);
+
+/**
+ * Called when a read queued with PRReadDataAsync() completes.
+ * On success data points at numWords words that are only valid for the duration of the call.
+ * On failure (no reply, or the reply was lost) data is NULL and numWords is 0.
+ */
+typedef void (*PRReadCallback)(PRHandle handle, PRResult result, uint32_t moduleSelect, uint32_t startingAddr, const uint32_t * data, int32_t numWords, void * userData);
+
+/**
+ * @brief Queues a read without waiting for the reply.
+ * The request goes out with the next PRFlushWriteData() (or any call that flushes), so several reads and
+ * writes can share one USB transfer.  Any number of reads, up to 256, may be outstanding at once.  Each reply
+ * is matched to its read by the address word the device returns with it and handed to callback.
+ *
+ * Callbacks run on the calling thread, from inside whichever call sorts incoming data: PRWaitForReads(),
+ * PRGetEvents(), PRGetEventsEx(), PRWaitForEvents() and the PRReadData() family.  A callback may queue
+ * further reads with PRReadDataAsync() but must not call any of those functions.
+ *
+ * Replies that match no outstanding read are counted in PRStats.readResponsesMismatched; replies that
+ * arrive after their read was given up on are counted in PRStats.readResponsesLate.
+ */
+PINPROC_API PRResult PRReadDataAsync(PRHandle handle, uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, PRReadCallback callback, void * userData);
+
+/**
+ * @brief Flushes write data and waits up to timeoutUs microseconds for every read queued with PRReadDataAsync() to complete.
+ * Reads still outstanding at the deadline are given up on: their callbacks are called with kPRFailure.
+ * @return The number of reads given up on (0 when all completed), or -1 on error.
+ */
+PINPROC_API int PRWaitForReads(PRHandle handle, uint32_t timeoutUs);
+
 // Manager
 /** @defgroup Manager
  * @{
@@ -654,6 +750,52 @@ typedef struct PREvent {
  */
 PINPROC_API int PRGetEvents(PRHandle handle, PREvent *eventsOut, int maxEvents);
 
+/** A PREvent with the timing and ordering information PRGetEventsEx() adds. */
+typedef struct PREventEx {
+    PREventType type;     /**< As in PREvent. */
+    uint32_t value;       /**< As in PREvent. */
+    uint32_t time;        /**< As in PREvent: the raw device timestamp, which wraps (every ~65 s on FPGA version 2 and later). */
+    uint64_t deviceTime;  /**< time unwrapped to 64 bits, in the same milliseconds.  Accelerometer events, whose timestamps are narrower, are placed on the same timeline.  A stretch longer than one wrap with no events at all can't be seen and is lost from the count. */
+    uint64_t hostTimeNs;  /**< Estimated time the host received the event: when libpinproc read it from the device, in nanoseconds on the monotonic clock (CLOCK_MONOTONIC on Linux). */
+    uint64_t sequence;    /**< Counts every event the handle has received, from 0.  Events dropped because the queue was full still use up a number, so a gap means events were lost. */
+} PREventEx;
+
+/** Like PRGetEvents(), with 64-bit timestamps and sequence numbers.  PRGetEvents() and PRGetEventsEx() take events from the same queue.
+ * \return Number of events returned; -1 if an error occurred.
+ */
+PINPROC_API int PRGetEventsEx(PRHandle handle, PREventEx *eventsOut, int maxEvents);
+
+/**
+ * @brief Waits up to timeoutUs microseconds for events to arrive.
+ * Returns as soon as unrequested data from the device is ready for PRGetEvents(), so a run loop can
+ * call this in place of sleeping.  With a timeout of 0 it only checks.
+ * \return Number of events ready; 0 if the timeout expired; -1 if an error occurred.
+ */
+PINPROC_API int PRWaitForEvents(PRHandle handle, uint32_t timeoutUs);
+
+/**
+ * @brief Returns a file descriptor that is readable while events are waiting, for use with select(), poll(), epoll or libuv.
+ * Requires a handle created with PRCreateOptions.useIOThread; the descriptor stays valid until PRDelete().
+ * Do not read from or close it; PRGetEvents() resets it once the events have been taken.
+ * \return The descriptor, or -1 if the handle has no I/O thread or the platform has no descriptor to offer (Windows).
+ */
+PINPROC_API int PRGetEventFD(PRHandle handle);
+
+/** Running counters kept by each handle.  All start at zero when the handle is created. */
+typedef struct PRStats {
+    uint64_t eventsDropped;          /**< Events discarded because the event queue (PRCreateOptions.eventQueueSize) was full. */
+    uint64_t requestedWordsDropped;  /**< Response words discarded because the requested data queue was full (with useIOThread, after a short wait for the application to make room). */
+    uint64_t readResponsesMismatched; /**< Read replies whose address word matched no outstanding read. */
+    uint64_t readResponsesLate;      /**< Read replies that arrived after their read timed out. */
+    uint64_t dmdBytesSent;           /**< Bytes of DMD frame data, burst headers included, sent by PRDMDDraw(). */
+    uint64_t dmdBytesSaved;          /**< Bytes PRDMDDraw() didn't send because the words were already in the frame buffer. */
+    uint64_t ledBytesSent;           /**< Bytes of PD-LED commands, burst headers included, sent by PRLEDUpdateFrame(). */
+    uint64_t ledBytesSaved;          /**< Bytes PRLEDUpdateFrame() didn't send, compared to PRLEDColor() and PRLEDFade() for each entry. */
+} PRStats;
+
+/** Copies the handle's counters into stats. */
+PINPROC_API PRResult PRGetStats(PRHandle handle, PRStats *stats);
+
 
 #define kPRSwitchPhysicalFirst (0)   /**< Switch number of the first physical switch. */
 #define kPRSwitchPhysicalLast (255)  /**< Switch number of the last physical switch.  */
@@ -763,8 +905,208 @@ typedef struct PRDMDConfig {
 
 /** Sets the configuration registers for the DMD driver. */
 PINPROC_API int32_t PRDMDUpdateConfig(PRHandle handle, PRDMDConfig *dmdConfig);
-/** Updates the DMD frame buffer with the given data. */
+
+/** What the timing PRDMDComputeTiming() chose works out to. */
+typedef struct PRDMDTiming {
+    uint32_t framePeriodNs;    /**< Time to show every subframe of every row once. */
+    uint32_t frameRateMilliHz; /**< Rate of kPREventTypeDMDFrameDisplayed events, in thousandths of a Hz. */
+    uint32_t numLevels;        /**< Distinct brightness levels a dot can show, including off. */
+    uint32_t onTimePermille;   /**< Share of the frame a fully lit dot is on, in thousandths. */
+} PRDMDTiming;
+
+/**
+ * Fills in the timing arrays of dmdConfig for its numColumns, numRows and numSubFrames so that frames refresh
+ * at refreshHz or faster.  Subframe s gets deHighCycles proportional to 2^s, so the default color map shows
+ * 2^numSubFrames levels, and as long as the frame allows so the dots are lit as long as possible.  Only the first
+ * four subframes have their own timing registers; later ones repeat the fourth and add fewer levels.
+ * Nonzero rclkLowCycles[0], latchHighCycles[0] and dotclkHalfPeriod[0] are kept for panels that need them,
+ * otherwise 15, 15 and 1 are used.  fpgaClockHz is 0 for the P-ROC's 50 MHz.
+ * Returns kPRFailure, with the fastest timing and its rate in timing, if the panel can't refresh at refreshHz.
+ */
+PINPROC_API PRResult PRDMDComputeTiming(PRDMDConfig *dmdConfig, uint32_t refreshHz, uint32_t fpgaClockHz, PRDMDTiming *timing);
+/**
+ * Updates the DMD frame buffer with the given data.
+ * The frame is sent right away, together with any buffered write data, and does not need a PRFlushWriteData().
+ * Frames larger than one USB burst are split into several.
+ *
+ * With PRDMDSetFrameDiffing() enabled, only the words that changed since the frame last sent to the same hardware
+ * frame buffer are sent.
+ */
 PINPROC_API PRResult PRDMDDraw(PRHandle handle, uint8_t * dots);
+/**
+ * Turns frame diffing in PRDMDDraw() and the calls built on it on or off; it is off by default.
+ * The library remembers what it last sent to each hardware frame buffer and only sends the words that changed
+ * (the savings show up in PRStats.dmdBytesSaved).  This assumes the FPGA moves its write pointer on by exactly
+ * one buffer, modulo numFrameBuffers, every time a frame is completed, and that nothing else writes the frame
+ * buffers.  Either call resends full frames until every buffer holds a known one.  PRDMDUpdateConfig() clears
+ * the frame buffers and starts over with full frames; call it again after anything else that resets the DMD.
+ */
+PINPROC_API PRResult PRDMDSetFrameDiffing(PRHandle handle, bool_t enable);
+
+/**
+ * Sets the color map PRDMDDrawGrayscale() applies to each pixel.  Entry n holds the subframe bits for pixel
+ * value n: bit s set lights the dot in subframe s.  A 16-entry map is for 4-bit pixels (the upper four bits of
+ * each pixel are ignored); a 256-entry map is for 8-bit pixels.  Passing NULL restores the default, which keeps
+ * the top numSubFrames bits of an 8-bit pixel so that subframe 0 is the least significant.
+ */
+PINPROC_API PRResult PRDMDSetColorMap(PRHandle handle, const uint8_t * colorMap, int32_t numEntries);
+/**
+ * Draws a frame of one byte per dot, numColumns wide and numRows high, with rows stride bytes apart.
+ * Each pixel goes through the color map and is packed into the subframe bitplanes PRDMDDraw() takes.
+ * numColumns must be a multiple of 8 and numSubFrames at most 8.
+ */
+PINPROC_API PRResult PRDMDDrawGrayscale(PRHandle handle, const uint8_t * pixels, uint32_t stride);
+/** Like PRDMDDrawGrayscale() for pixels that already hold subframe bits, skipping the color map. */
+PINPROC_API PRResult PRDMDDrawMapped(PRHandle handle, const uint8_t * pixels, uint32_t stride);
+#define kPRDMDMaxEncodeColumns (256) /**< Widest frame PRDMDEncodeFrame() and PRDMDDrawGrayscale() pack. */
+/**
+ * Packs a frame of pixels into the buffer PRDMDDraw() takes, without a handle: numSubFrames planes of
+ * numRows * numColumns / 8 bytes, the leftmost dot of each byte in bit 0.  colorMap has 256 entries as for
+ * PRDMDSetColorMap(), or is NULL if the pixels already hold subframe bits.
+ */
+PINPROC_API PRResult PRDMDEncodeFrame(const uint8_t * pixels, uint32_t stride, uint16_t numColumns, uint8_t numRows, uint8_t numSubFrames, const uint8_t * colorMap, uint8_t * dots);
+
+/** Counters and depth of the DMD frame queue, from PRDMDQueueGetStatus(). */
+typedef struct PRDMDQueueStatus {
+    uint32_t depth;           /**< Frames waiting in the queue. */
+    uint32_t capacity;        /**< Most frames the queue holds. */
+    uint32_t buffersFilled;   /**< Frames uploaded to the hardware buffers and not yet displayed. */
+    uint64_t framesQueued;    /**< Frames accepted by PRDMDQueueFrame(). */
+    uint64_t framesUploaded;  /**< Frames sent to the hardware. */
+    uint64_t framesDropped;   /**< Frames skipped because a later frame was already due. */
+    uint64_t framesLate;      /**< Frames uploaded at a later frame event than the first one after their display time. */
+    uint64_t underruns;       /**< Frame events that found no new frame in the hardware buffers, so a frame was shown again. */
+} PRDMDQueueStatus;
+
+/**
+ * @brief Queues a frame (as taken by PRDMDDraw()) to be uploaded when it is due.
+ * The library uploads one queued frame for each kPREventTypeDMDFrameDisplayed event it passes to
+ * PRGetEvents() or PRGetEventsEx(), keeping the buffers that autoIncBufferWrPtr cycles through full.
+ * Until then the frames ahead of it are shown.  The queue needs enableFrameEvents in the DMD config;
+ * PRDMDUpdateConfig() empties it.  Don't mix it with PRDMDDraw(), which takes a buffer the queue counts on.
+ *
+ * Frames are uploaded in the order they are queued.  A frame is due once the monotonic clock (as in
+ * PREventEx.hostTimeNs) reaches displayTimeNs; 0 makes it due at once.  When several frames are due at a
+ * frame event, all but the last are dropped.
+ * \return kPRFailure if the queue is full or frame events are off; the frame is not queued.
+ */
+PINPROC_API PRResult PRDMDQueueFrame(PRHandle handle, const uint8_t * dots, uint64_t displayTimeNs);
+/** Discards the frames waiting in the DMD frame queue.  Frames already uploaded are still displayed. */
+PINPROC_API PRResult PRDMDQueueClear(PRHandle handle);
+/** Copies the DMD frame queue's depth and counters into status. */
+PINPROC_API PRResult PRDMDQueueGetStatus(PRHandle handle, PRDMDQueueStatus * status);
+
+typedef void * PRDMDAnimationHandle; /**< Opaque reference to an animation file opened with PRDMDAnimationOpen(). */
+#define kPRDMDAnimationHandleInvalid (0) /**< Value returned by PRDMDAnimationOpen() on failure. */
+
+/** Geometry and length of a DMD animation, from PRDMDAnimationGetInfo(). */
+typedef struct PRDMDAnimationInfo {
+    uint16_t numColumns;
+    uint8_t numRows;
+    uint8_t numSubFrames;
+    uint32_t numFrames;       /**< Entries in the frame index. */
+    uint32_t frameBytes;      /**< Bytes of dots per frame, as PRDMDDraw() takes them. */
+    uint64_t numFrameEvents;  /**< Length of one pass in frame events: the sum of the frames' repeat counts. */
+} PRDMDAnimationInfo;
+
+/**
+ * @brief Opens a pre-encoded DMD animation for PRDMDPlayAnimation().
+ * The file is memory mapped; frames are sent from the mapping as they play, so opening it decodes nothing
+ * and memory use doesn't depend on its length.  All fields are little-endian:
+ *
+ * - Header, 24 bytes: the magic "PDMA"; uint16 version (1); uint16 numColumns; uint8 numRows;
+ *   uint8 numSubFrames; 2 reserved bytes; uint32 numFrames; uint32 frameBytes
+ *   (numColumns * numRows / 8 * numSubFrames); 4 reserved bytes.
+ * - Frame index, numFrames entries of 16 bytes: uint64 offset of the frame's dots from the start of the
+ *   file, a multiple of 4; uint32 repeat, the number of frame events the frame is shown for (0 counts as 1);
+ *   4 reserved bytes.  Entries may share the same dots.
+ * - Frame data: frameBytes each, laid out as PRDMDEncodeFrame() produces them.
+ *
+ * \return #kPRDMDAnimationHandleInvalid if the file can't be mapped or isn't valid; see PRGetLastErrorText().
+ */
+PINPROC_API PRDMDAnimationHandle PRDMDAnimationOpen(const char * path);
+/** Releases the handle.  The file stays mapped until every device playing the animation has stopped it. */
+PINPROC_API void PRDMDAnimationClose(PRDMDAnimationHandle animation);
+/** Copies the animation's geometry and length into info. */
+PINPROC_API PRResult PRDMDAnimationGetInfo(PRDMDAnimationHandle animation, PRDMDAnimationInfo * info);
+/**
+ * @brief Plays an animation on the DMD, one frame per kPREventTypeDMDFrameDisplayed event.
+ * Frames are sent as PRGetEvents() or PRGetEventsEx() pass the frame events along, like queued frames;
+ * PRDMDQueueFrame() frames wait until the animation ends.  The animation's geometry must match the DMD
+ * config, which needs enableFrameEvents.  A playing animation replaces the one playing before.
+ * Without loop the last frame stays up once the animation ends.
+ */
+PINPROC_API PRResult PRDMDPlayAnimation(PRHandle handle, PRDMDAnimationHandle animation, bool_t loop);
+/** Stops the playing animation.  The frames already sent are still displayed. */
+PINPROC_API PRResult PRDMDStopAnimation(PRHandle handle);
+/** \return The index entry of the animation frame sent last, or -1 if no animation is playing. */
+PINPROC_API int32_t PRDMDAnimationCurrentFrame(PRHandle handle);
+
+/** How a DMD layer is blended onto the layers below it. */
+typedef enum PRDMDLayerMode {
+    kPRDMDLayerOpaque = 0, /**< Covers everything below. */
+    kPRDMDLayerMasked = 1, /**< Pixels of 0 are transparent; the rest cover what is below. */
+    kPRDMDLayerAlpha = 2   /**< Blended by a per-pixel alpha plane from PRDMDLayerSetAlpha(), 255 being opaque. */
+} PRDMDLayerMode;
+
+/**
+ * @brief Adds a layer to the handle's DMD compositor, above the layers created before it.
+ * Layers hold 8-bit pixels, start out black (alpha layers fully opaque) at position 0,0, and may be any
+ * size; the parts that fall outside the display are clipped.  PRDMDComposite() blends the layers into a
+ * frame, maps it through the color map and draws it.  A handle has up to 16 layers.
+ * \return The layer's index, or -1 if it can't be created.
+ */
+PINPROC_API int32_t PRDMDLayerCreate(PRHandle handle, uint16_t width, uint8_t height, PRDMDLayerMode mode);
+/**
+ * Copies pixels into a layer: height rows of width pixels, stride bytes apart.  With bitsPerPixel 4 each
+ * byte holds a value from 0 to 15 in its low bits, stretched to 0-255; with 8 the bytes are used as they are.
+ */
+PINPROC_API PRResult PRDMDLayerSetPixels(PRHandle handle, int32_t layer, const uint8_t * pixels, uint32_t stride, uint8_t bitsPerPixel);
+/** Copies a kPRDMDLayerAlpha layer's alpha plane, laid out like its pixels. */
+PINPROC_API PRResult PRDMDLayerSetAlpha(PRHandle handle, int32_t layer, const uint8_t * alpha, uint32_t stride);
+/** Moves a layer's top left corner to x, y on the display; either may be negative. */
+PINPROC_API PRResult PRDMDLayerSetPosition(PRHandle handle, int32_t layer, int16_t x, int16_t y);
+/** Shows or hides a layer. */
+PINPROC_API PRResult PRDMDLayerSetVisible(PRHandle handle, int32_t layer, bool_t visible);
+/** Removes all of the handle's layers. */
+PINPROC_API PRResult PRDMDLayersRemove(PRHandle handle);
+/**
+ * @brief Blends the layers and draws the result with PRDMDDrawGrayscale().
+ * Only the rows changed since the last call are blended again, and if nothing changed, nothing is drawn.
+ */
+PINPROC_API PRResult PRDMDComposite(PRHandle handle);
+
+typedef void * PRDMDFontHandle; /**< Opaque reference to a glyph cache created with PRDMDFontCreate(). */
+#define kPRDMDFontHandleInvalid (0) /**< Value returned by PRDMDFontCreate() on failure. */
+
+/**
+ * @brief Creates an empty glyph cache for drawing text into DMD frames.
+ * Glyphs are stored already split into numSubFrames bitplanes, so drawing a string is a table lookup and a few
+ * shifted ORs per glyph row and subframe, with no allocation.  Fonts don't belong to a handle.
+ * \param height Rows in every glyph.
+ * \param spacing Blank columns added after each glyph.
+ * \return #kPRDMDFontHandleInvalid if height is 0 or numSubFrames isn't 1 to 8.
+ */
+PINPROC_API PRDMDFontHandle PRDMDFontCreate(uint8_t height, uint8_t numSubFrames, uint8_t spacing);
+/** Frees a glyph cache. */
+PINPROC_API void PRDMDFontDelete(PRDMDFontHandle font);
+/**
+ * @brief Rasterizes and caches the glyph for one character, replacing any glyph it had.
+ * pixels holds the font's height rows of width (1 to 32) pixels, stride bytes apart.  Each goes through
+ * colorMap (256 entries, as for PRDMDSetColorMap()), or keeps its top numSubFrames bits if colorMap is NULL.
+ * Pixels that map to 0 are transparent.  Give the space character a blank glyph.
+ */
+PINPROC_API PRResult PRDMDFontAddGlyph(PRDMDFontHandle font, uint8_t character, const uint8_t * pixels, uint8_t width, uint32_t stride, const uint8_t * colorMap);
+/**
+ * @brief Draws text into a frame in the layout PRDMDDraw() takes, with its top left corner at x, y.
+ * dots is numColumns by numRows with at least the font's number of subframes.  Each glyph's pixels replace
+ * the dots under them; its transparent pixels and characters without a glyph draw nothing.  Text is clipped
+ * to the frame.
+ * \return The x just past the last glyph drawn, spacing included.
+ */
+PINPROC_API int32_t PRDMDFontDrawText(PRDMDFontHandle font, uint8_t * dots, uint16_t numColumns, uint8_t numRows, int32_t x, int32_t y, const char * text);
+/** \return The width of text in columns, without the spacing after the last glyph. */
+PINPROC_API int32_t PRDMDFontTextWidth(PRDMDFontHandle font, const char * text);
 
 /** @} */ // End of DMD
 
@@ -839,9 +1181,83 @@ PINPROC_API PRResult PRLEDRGBFade(PRHandle handle, PRLEDRGB * pLED, uint32_t fad
 /** Sets the fade color on a given PRLEDRGB. */
 PINPROC_API PRResult PRLEDRGBFadeColor(PRHandle handle, PRLEDRGB * pLED, uint32_t fadeColor);
 
+/** One LED's state for PRLEDUpdateFrame(). */
+typedef struct PRLEDFrameEntry {
+    uint8_t boardAddr;
+    uint8_t LEDIndex;
+    uint8_t color;      /**< Color to show, or to fade to if fadeRate isn't 0. */
+    uint16_t fadeRate;  /**< 0 sets color right away, as PRLEDColor(); otherwise the LED fades to it at this rate, as PRLEDFade(). */
+} PRLEDFrameEntry;
+
+/**
+ * Brings numEntries LEDs to the given states, sending only the commands needed to change what the PD-LED
+ * boards already hold.  The library keeps a shadow of each board's LED index and fade rate registers and of
+ * each LED's color or fade target and rate, updated by every PD-LED call, so an LED already showing the entry's
+ * color, or fading to it at the entry's rate, costs nothing, and consecutive entries on one board skip repeated index and fade rate writes.
+ * An RGB LED takes three entries.  The fade rate is per board, so a board's fading entries go out fastest
+ * when they share a rate.  The savings show up in PRStats.ledBytesSaved.  PRReset() forgets the shadow, so
+ * the next frame is sent in full.  Like the other PD-LED calls, the commands are sent with the next
+ * PRFlushWriteData().
+ */
+PINPROC_API PRResult PRLEDUpdateFrame(PRHandle handle, const PRLEDFrameEntry * entries, int32_t numEntries);
+
 
 /** @} */ // End of PD-LED
 
+// Simulator
+
+/**
+ * @defgroup simulator Simulator
+ * Scripting hooks for handles created by PRCreateEx() with #kPRTransportSimulator.
+ * The simulator keeps its own clock in microseconds, starting at 0 when the handle is created.
+ * The clock only moves when PRSimulatorAdvance() is called, so a script produces the same events on every run.
+ * These calls fail on handles using any other transport.
+ * @{
+ */
+
+typedef enum PRSimulatorEventType {
+    kPRSimulatorEventSwitchClosed = 0,  /**< The switch closes.  Nondebounced and, after the debounce time, debounced switch rules fire. */
+    kPRSimulatorEventSwitchOpen = 1,    /**< The switch opens. */
+    kPRSimulatorEventDMDFrame = 2,      /**< A frame-displayed event for the given frame buffer, independent of the DMD timing. */
+    kPRSimulatorEventAccelerometer = 3  /**< An accelerometer reading.  number is the axis: 0 = X, 1 = Y, 2 = Z, 3 = IRQ. */
+} PRSimulatorEventType;
+
+typedef struct PRSimulatorEvent {
+    uint64_t time;              /**< Simulated time in microseconds.  Times in the past fire on the next PRSimulatorAdvance(). */
+    PRSimulatorEventType type;
+    uint16_t number;            /**< Switch number, frame buffer or accelerometer axis. */
+    uint16_t value;             /**< Accelerometer reading (14 bits).  Unused by the other types. */
+} PRSimulatorEvent;
+
+/** Adds events to the simulator's timeline.  Events with the same time fire in the order given. */
+PINPROC_API PRResult PRSimulatorScheduleEvents(PRHandle handle, const PRSimulatorEvent *events, int numEvents);
+/** Runs the simulated board forward, firing scheduled events, switch debouncing, pulse timeouts and DMD frames in time order.  Resulting events are returned by PRGetEvents(). */
+PINPROC_API PRResult PRSimulatorAdvance(PRHandle handle, uint32_t microseconds);
+/** Gets the simulated time in microseconds. */
+PINPROC_API PRResult PRSimulatorGetTime(PRHandle handle, uint64_t *time);
+/** Opens or closes a switch now.  Shorthand for scheduling one event at the current time and calling PRSimulatorAdvance(handle, 0). */
+PINPROC_API PRResult PRSimulatorSetSwitch(PRHandle handle, uint16_t switchNum, bool_t open);
+/** Gets a driver's state as the simulated driver controller has it, including changes made by switch rules and expired pulses. */
+PINPROC_API PRResult PRSimulatorGetDriverState(PRHandle handle, uint16_t driverNum, PRDriverState *driverState);
+/**
+ * @brief Copies the dot table words the simulated DMD controller holds for one frame buffer.
+ * @return Number of words copied, or -1 if an error occurred.
+ */
+PINPROC_API int PRSimulatorGetDMDFrame(PRHandle handle, uint8_t frameBuffer, uint32_t *words, int maxWords);
+
+/** One LED on a simulated PD-LED board, from PRSimulatorGetLEDState(). */
+typedef struct PRSimulatorLEDState {
+    uint8_t color;       /**< Last value written to the LED's color register. */
+    uint8_t fadeColor;   /**< Last value written to the LED's fade color register. */
+    uint16_t fadeRate;   /**< The board's fade rate when fadeColor was written. */
+    uint32_t numWrites;  /**< Color and fade color writes the LED has received. */
+} PRSimulatorLEDState;
+
+/** Gets an LED's registers as the simulated PD-LED board has them, following the PDB commands the driver controller passed on. */
+PINPROC_API PRResult PRSimulatorGetLEDState(PRHandle handle, uint8_t boardAddr, uint8_t LEDIndex, PRSimulatorLEDState *state);
+
+/** @} */ // End of Simulator
+
 
 /** @cond */
 PINPROC_EXTERN_C_END
@@ -0,0 +1,181 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRByteOrder.cpp
+ *  libpinproc
+ */
+
+#include <string.h>
+#include "PRByteOrder.h"
+#include "PRCPU.h"
+#if defined(PR_ARCH_X86)
+#include <immintrin.h>
+#endif
+#if defined(PR_ARCH_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define PR_HOST_BIG_ENDIAN 1
+#endif
+
+typedef void (*SwapWordsFn)(void *dst, const void *src, int numWords);
+
+static inline uint32_t SwapWord(uint32_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_bswap32(word);
+#elif defined(_MSC_VER)
+    return _byteswap_ulong(word);
+#else
+    return (word >> 24) | ((word >> 8) & 0xFF00) | ((word << 8) & 0xFF0000) | (word << 24);
+#endif
+}
+
+// memcpy keeps the loads and stores legal for unaligned byte buffers and
+// compiles to plain moves.
+static void SwapWordsScalar(void *dst, const void *src, int numWords)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    for (int i = 0; i < numWords; i++)
+    {
+        uint32_t word;
+        memcpy(&word, s + i * 4, 4);
+        word = SwapWord(word);
+        memcpy(d + i * 4, &word, 4);
+    }
+}
+
+#if defined(PR_ARCH_X86)
+PR_TARGET("ssse3")
+static void SwapWordsSSSE3(void *dst, const void *src, int numWords)
+{
+    const __m128i shuffle = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    int i = 0;
+    for (; i + 4 <= numWords; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i * 4));
+        _mm_storeu_si128((__m128i *)(d + i * 4), _mm_shuffle_epi8(v, shuffle));
+    }
+    SwapWordsScalar(d + i * 4, s + i * 4, numWords - i);
+}
+
+PR_TARGET("avx2")
+static void SwapWordsAVX2(void *dst, const void *src, int numWords)
+{
+    const __m256i shuffle = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                             3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    int i = 0;
+    for (; i + 8 <= numWords; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i * 4));
+        _mm256_storeu_si256((__m256i *)(d + i * 4), _mm256_shuffle_epi8(v, shuffle));
+    }
+    SwapWordsSSSE3(d + i * 4, s + i * 4, numWords - i);
+}
+#endif
+
+#if defined(PR_ARCH_NEON)
+static void SwapWordsNEON(void *dst, const void *src, int numWords)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    int i = 0;
+    for (; i + 4 <= numWords; i += 4)
+        vst1q_u8(d + i * 4, vrev32q_u8(vld1q_u8(s + i * 4)));
+    SwapWordsScalar(d + i * 4, s + i * 4, numWords - i);
+}
+#endif
+
+static void CopyWords(void *dst, const void *src, int numWords)
+{
+    memcpy(dst, src, numWords * 4);
+}
+
+struct SwapKernel
+{
+    SwapWordsFn fn;
+    const char *name;
+};
+
+static SwapKernel SelectKernel()
+{
+    SwapKernel kernel = { SwapWordsScalar, "scalar" };
+#if defined(PR_HOST_BIG_ENDIAN)
+    kernel.fn = CopyWords;
+    kernel.name = "copy";
+#else
+    uint32_t features = PRCPUFeatures();
+    (void)features;
+    (void)CopyWords;
+#if defined(PR_ARCH_X86)
+    if (features & kPRCPUAVX2)
+    {
+        kernel.fn = SwapWordsAVX2;
+        kernel.name = "avx2";
+    }
+    else if (features & kPRCPUSSSE3)
+    {
+        kernel.fn = SwapWordsSSSE3;
+        kernel.name = "ssse3";
+    }
+#endif
+#if defined(PR_ARCH_NEON)
+    if (features & kPRCPUNEON)
+    {
+        kernel.fn = SwapWordsNEON;
+        kernel.name = "neon";
+    }
+#endif
+#endif
+    return kernel;
+}
+
+static const SwapKernel &Kernel()
+{
+    static const SwapKernel kernel = SelectKernel();
+    return kernel;
+}
+
+void PRWordsToWire(uint8_t *dst, const uint32_t *src, int numWords)
+{
+    Kernel().fn(dst, src, numWords);
+}
+
+void PRWireToWords(uint32_t *dst, const uint8_t *src, int numWords)
+{
+    Kernel().fn(dst, src, numWords);
+}
+
+const char *PRByteOrderKernelName()
+{
+    return Kernel().name;
+}
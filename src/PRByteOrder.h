@@ -0,0 +1,57 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRByteOrder.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRBYTEORDER_H
+#define PINPROC_PRBYTEORDER_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+
+// The FPGA sends and receives 32-bit words most significant byte first.
+// On a little-endian host both directions are the same byte reversal,
+// done with the widest kernel PRCPUFeatures() allows (AVX2 or SSSE3 pshufb,
+// NEON vrev32, or scalar bswap).  On a big-endian host they are copies.
+// dst and src must not overlap.
+
+/** Host words to wire bytes. */
+void PRWordsToWire(uint8_t *dst, const uint32_t *src, int numWords);
+/** Wire bytes to host words. */
+void PRWireToWords(uint32_t *dst, const uint8_t *src, int numWords);
+/** Name of the kernel in use, for logging and benchmarks. */
+const char *PRByteOrderKernelName();
+
+/** One wire word to a host word, for parsers that read in place.  Compiles to a load and bswap. */
+static inline uint32_t PRWireToWord(const uint8_t *src)
+{
+    return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | (uint32_t)src[3];
+}
+
+#endif /* PINPROC_PRBYTEORDER_H */
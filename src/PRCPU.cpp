@@ -0,0 +1,72 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRCPU.cpp
+ *  libpinproc
+ */
+
+#include <stdlib.h>
+#include "PRCPU.h"
+#if defined(PR_ARCH_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static uint32_t DetectCPUFeatures()
+{
+    uint32_t features = 0;
+
+    if (getenv("PINPROC_NO_SIMD") != NULL)
+        return 0;
+
+#if defined(PR_ARCH_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26)) features |= kPRCPUSSE2;
+    if (info[2] & (1 << 9)) features |= kPRCPUSSSE3;
+    // AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0).
+    bool osAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 0x6) == 0x6);
+    __cpuidex(info, 7, 0);
+    if (osAVX && (info[1] & (1 << 5))) features |= kPRCPUAVX2;
+#elif defined(PR_ARCH_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) features |= kPRCPUSSE2;
+    if (__builtin_cpu_supports("ssse3")) features |= kPRCPUSSSE3;
+    if (__builtin_cpu_supports("avx2")) features |= kPRCPUAVX2;
+#endif
+
+#if defined(PR_ARCH_NEON)
+    features |= kPRCPUNEON;
+#endif
+
+    return features;
+}
+
+uint32_t PRCPUFeatures()
+{
+    static const uint32_t features = DetectCPUFeatures();
+    return features;
+}
@@ -0,0 +1,68 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRCPU.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRCPU_H
+#define PINPROC_PRCPU_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PR_ARCH_X86 1
+#endif
+
+// NEON kernels are only built when the compiler targets NEON (always true
+// on AArch64; -mfpu=neon on 32-bit ARM such as Raspbian).
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define PR_ARCH_NEON 1
+#endif
+
+// Lets a single translation unit hold kernels for several instruction sets.
+// MSVC accepts the intrinsics without any per-function annotation.
+#if defined(__GNUC__) || defined(__clang__)
+#define PR_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PR_TARGET(isa)
+#endif
+
+#define kPRCPUSSE2   (1 << 0)
+#define kPRCPUSSSE3  (1 << 1)
+#define kPRCPUAVX2   (1 << 2)
+#define kPRCPUNEON   (1 << 3)
+
+/**
+ * Instruction sets usable on this machine, as kPRCPU* bits.
+ * Detected once; setting PINPROC_NO_SIMD in the environment reports none,
+ * which forces the scalar kernels for comparison.
+ */
+uint32_t PRCPUFeatures();
+
+#endif /* PINPROC_PRCPU_H */
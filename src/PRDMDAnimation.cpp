@@ -0,0 +1,210 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDAnimation.cpp
+ *  libpinproc
+ */
+
+#include "PRDMDAnimation.h"
+#include "PRCommon.h"
+#include <string.h>
+#if defined(__WIN32__) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define animationHeaderBytes (24)
+#define animationIndexEntryBytes (16)
+#define animationVersion (1)
+
+static uint32_t ReadLE16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t ReadLE32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t ReadLE64(const uint8_t *p)
+{
+    return ReadLE32(p) | ((uint64_t)ReadLE32(p + 4) << 32);
+}
+
+PRDMDAnimation::PRDMDAnimation() : refCount(1), data(NULL), size(0), index(NULL)
+#if defined(__WIN32__) || defined(_WIN32)
+    , fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+#endif
+{
+    memset(&info, 0x00, sizeof(info));
+}
+
+PRDMDAnimation *PRDMDAnimation::Open(const char *path)
+{
+    PRDMDAnimation *animation = new PRDMDAnimation();
+
+#if defined(__WIN32__) || defined(_WIN32)
+    animation->fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER fileSize;
+    if (animation->fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(animation->fileHandle, &fileSize))
+    {
+        PRSetLastErrorText("Can't open DMD animation %s", path);
+        delete animation;
+        return NULL;
+    }
+    animation->size = fileSize.QuadPart;
+    if (animation->size > 0)
+    {
+        animation->mappingHandle = CreateFileMappingA(animation->fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (animation->mappingHandle != NULL)
+            animation->data = (const uint8_t *)MapViewOfFile(animation->mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (animation->data == NULL)
+        {
+            PRSetLastErrorText("Can't map DMD animation %s", path);
+            delete animation;
+            return NULL;
+        }
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        PRSetLastErrorText("Can't open DMD animation %s", path);
+        if (fd >= 0)
+            close(fd);
+        delete animation;
+        return NULL;
+    }
+    animation->size = st.st_size;
+    if (animation->size > 0)
+    {
+        void *mapping = mmap(NULL, animation->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED)
+            animation->data = (const uint8_t *)mapping;
+    }
+    // The mapping keeps the file referenced on its own.
+    close(fd);
+    if (animation->size > 0 && animation->data == NULL)
+    {
+        PRSetLastErrorText("Can't map DMD animation %s", path);
+        delete animation;
+        return NULL;
+    }
+#endif
+
+    if (animation->Check() != kPRSuccess)
+    {
+        delete animation;
+        return NULL;
+    }
+    return animation;
+}
+
+void PRDMDAnimation::Release()
+{
+    if (--refCount == 0)
+        delete this;
+}
+
+PRDMDAnimation::~PRDMDAnimation()
+{
+#if defined(__WIN32__) || defined(_WIN32)
+    if (data != NULL)
+        UnmapViewOfFile(data);
+    if (mappingHandle != NULL)
+        CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(fileHandle);
+#else
+    if (data != NULL)
+        munmap((void *)data, size);
+#endif
+}
+
+PRResult PRDMDAnimation::Check()
+{
+    if (size < animationHeaderBytes || memcmp(data, "PDMA", 4) != 0)
+    {
+        PRSetLastErrorText("Not a DMD animation file.");
+        return kPRFailure;
+    }
+    if (ReadLE16(data + 4) != animationVersion)
+    {
+        PRSetLastErrorText("Unsupported DMD animation version %d.", ReadLE16(data + 4));
+        return kPRFailure;
+    }
+
+    info.numColumns = ReadLE16(data + 6);
+    info.numRows = data[8];
+    info.numSubFrames = data[9];
+    info.numFrames = ReadLE32(data + 12);
+    info.frameBytes = ReadLE32(data + 16);
+    if (info.numColumns % 8 != 0 || info.frameBytes == 0 ||
+        info.frameBytes != (uint32_t)info.numColumns * info.numRows / 8 * info.numSubFrames)
+    {
+        PRSetLastErrorText("DMD animation frame size %d doesn't match %dx%d with %d subframes.",
+                           info.frameBytes, info.numColumns, info.numRows, info.numSubFrames);
+        return kPRFailure;
+    }
+    if (info.numFrames == 0 || (size - animationHeaderBytes) / animationIndexEntryBytes < info.numFrames)
+    {
+        PRSetLastErrorText("DMD animation index is empty or truncated.");
+        return kPRFailure;
+    }
+
+    // Only the index is read here; the frame data isn't touched until it plays.
+    index = data + animationHeaderBytes;
+    info.numFrameEvents = 0;
+    for (uint32_t i = 0; i < info.numFrames; i++)
+    {
+        uint64_t offset = ReadLE64(index + i * animationIndexEntryBytes);
+        // Frames go to DMDDraw() as words, so they must be word aligned.
+        if (offset % 4 != 0 || offset > size || size - offset < info.frameBytes)
+        {
+            PRSetLastErrorText("DMD animation frame %d isn't word aligned or lies outside the file.", i);
+            return kPRFailure;
+        }
+        info.numFrameEvents += Repeat(i);
+    }
+    return kPRSuccess;
+}
+
+const uint8_t *PRDMDAnimation::Frame(uint32_t i) const
+{
+    return data + ReadLE64(index + i * animationIndexEntryBytes);
+}
+
+uint32_t PRDMDAnimation::Repeat(uint32_t i) const
+{
+    uint32_t repeat = ReadLE32(index + i * animationIndexEntryBytes + 8);
+    return repeat > 0 ? repeat : 1;
+}
@@ -0,0 +1,86 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDAnimation.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRDMDANIMATION_H
+#define PINPROC_PRDMDANIMATION_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <atomic>
+#include "pinproc.h"
+
+/**
+ * A pre-encoded DMD animation, mapped read-only from its file.  Frames are
+ * used where they lie in the mapping; nothing is decoded or copied when the
+ * file is opened, so memory use doesn't grow with the animation's length.
+ *
+ * The file layout is described with PRDMDAnimationOpen() in pinproc.h.  All
+ * header and index fields are little-endian.
+ *
+ * Animations are reference counted: Open() returns one reference, owned by
+ * the PRDMDAnimationHandle, and each device playing the animation holds
+ * another, so closing the handle mid-playback leaves the mapping in place
+ * until the last device lets go of it.
+ */
+class PRDMDAnimation
+{
+public:
+    /** Maps and checks the file; returns NULL with the error text set if it can't be used. */
+    static PRDMDAnimation *Open(const char *path);
+    void Retain() { refCount++; }
+    /** Drops a reference, unmapping the file once none are left. */
+    void Release();
+
+    void GetInfo(PRDMDAnimationInfo *info) const { *info = this->info; }
+    uint32_t NumFrames() const { return info.numFrames; }
+    /** The dots of index entry i, in the layout PRDMDDraw() takes. */
+    const uint8_t *Frame(uint32_t i) const;
+    /** Frame events entry i stays on the display for; at least 1. */
+    uint32_t Repeat(uint32_t i) const;
+
+private:
+    PRDMDAnimation();
+    ~PRDMDAnimation();
+    PRResult Check();
+
+    std::atomic<int32_t> refCount;
+
+    const uint8_t *data;
+    uint64_t size;
+    const uint8_t *index;
+    PRDMDAnimationInfo info;
+#if defined(__WIN32__) || defined(_WIN32)
+    void *fileHandle;
+    void *mappingHandle;
+#endif
+};
+
+#endif /* PINPROC_PRDMDANIMATION_H */
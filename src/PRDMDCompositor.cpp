@@ -0,0 +1,416 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDCompositor.cpp
+ *  libpinproc
+ */
+
+#include "PRDMDCompositor.h"
+#include "PRCommon.h"
+#include "PRCPU.h"
+#include <string.h>
+#include <algorithm>
+#if defined(PR_ARCH_X86)
+#include <immintrin.h>
+#endif
+#if defined(PR_ARCH_NEON)
+#include <arm_neon.h>
+#endif
+
+// Blending works on a run of pixels within one row.  Masked layers are
+// transparent where a pixel is 0.  Alpha layers mix as
+// (src * a + dst * (255 - a)) / 255, rounded; the sum fits in 16 bits, and
+// (x + (x >> 8)) >> 8 divides it by 255 once 128 has been added.
+
+typedef void (*BlendMaskFn)(uint8_t *dst, const uint8_t *src, int n);
+typedef void (*BlendAlphaFn)(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int n);
+
+static void BlendMaskScalar(uint8_t *dst, const uint8_t *src, int n)
+{
+    for (int i = 0; i < n; i++)
+        if (src[i] != 0)
+            dst[i] = src[i];
+}
+
+static void BlendAlphaScalar(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t x = src[i] * alpha[i] + dst[i] * (255 - alpha[i]) + 128;
+        dst[i] = (uint8_t)((x + (x >> 8)) >> 8);
+    }
+}
+
+#if defined(PR_ARCH_X86)
+PR_TARGET("sse2")
+static void BlendMaskSSE2(uint8_t *dst, const uint8_t *src, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i clear = _mm_cmpeq_epi8(s, _mm_setzero_si128());
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_and_si128(clear, d), _mm_andnot_si128(clear, s)));
+    }
+    BlendMaskScalar(dst + i, src + i, n - i);
+}
+
+PR_TARGET("sse2")
+static __m128i BlendHalfSSE2(__m128i s, __m128i d, __m128i a)
+{
+    const __m128i ones = _mm_set1_epi16(255);
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(ones, a)));
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+PR_TARGET("sse2")
+static void BlendAlphaSSE2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i a = _mm_loadu_si128((const __m128i *)(alpha + i));
+        __m128i lo = BlendHalfSSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(a, zero));
+        __m128i hi = BlendHalfSSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(a, zero));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    BlendAlphaScalar(dst + i, src + i, alpha + i, n - i);
+}
+
+PR_TARGET("avx2")
+static void BlendMaskAVX2(uint8_t *dst, const uint8_t *src, int n)
+{
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i clear = _mm256_cmpeq_epi8(s, _mm256_setzero_si256());
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_blendv_epi8(s, d, clear));
+    }
+    BlendMaskSSE2(dst + i, src + i, n - i);
+}
+
+PR_TARGET("avx2")
+static void BlendAlphaAVX2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int n)
+{
+    const __m256i ones = _mm256_set1_epi16(255);
+    const __m256i half = _mm256_set1_epi16(128);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        // Widen 16 pixels to 16-bit lanes; the pack at the end narrows them
+        // back in order because both halves come from the same 128-bit lane.
+        __m256i s = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i)));
+        __m256i d = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(dst + i)));
+        __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(alpha + i)));
+        __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, _mm256_sub_epi16(ones, a)));
+        x = _mm256_add_epi16(x, half);
+        x = _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+        __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+        _mm_storeu_si128((__m128i *)(dst + i), packed);
+    }
+    BlendAlphaScalar(dst + i, src + i, alpha + i, n - i);
+}
+#endif
+
+#if defined(PR_ARCH_NEON)
+static void BlendMaskNEON(uint8_t *dst, const uint8_t *src, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t d = vld1q_u8(dst + i);
+        vst1q_u8(dst + i, vbslq_u8(vceqq_u8(s, vdupq_n_u8(0)), d, s));
+    }
+    BlendMaskScalar(dst + i, src + i, n - i);
+}
+
+static void BlendAlphaNEON(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint8x8_t s = vld1_u8(src + i);
+        uint8x8_t d = vld1_u8(dst + i);
+        uint8x8_t a = vld1_u8(alpha + i);
+        uint16x8_t x = vmlal_u8(vmull_u8(s, a), d, vmvn_u8(a));
+        x = vaddq_u16(x, vdupq_n_u16(128));
+        vst1_u8(dst + i, vshrn_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8));
+    }
+    BlendAlphaScalar(dst + i, src + i, alpha + i, n - i);
+}
+#endif
+
+struct BlendKernel
+{
+    BlendMaskFn mask;
+    BlendAlphaFn alpha;
+    const char *name;
+};
+
+static BlendKernel SelectKernel()
+{
+    BlendKernel kernel = { BlendMaskScalar, BlendAlphaScalar, "scalar" };
+    uint32_t features = PRCPUFeatures();
+    (void)features;
+#if defined(PR_ARCH_X86)
+    if (features & kPRCPUAVX2)
+    {
+        kernel.mask = BlendMaskAVX2;
+        kernel.alpha = BlendAlphaAVX2;
+        kernel.name = "avx2";
+    }
+    else if (features & kPRCPUSSE2)
+    {
+        kernel.mask = BlendMaskSSE2;
+        kernel.alpha = BlendAlphaSSE2;
+        kernel.name = "sse2";
+    }
+#endif
+#if defined(PR_ARCH_NEON)
+    if (features & kPRCPUNEON)
+    {
+        kernel.mask = BlendMaskNEON;
+        kernel.alpha = BlendAlphaNEON;
+        kernel.name = "neon";
+    }
+#endif
+    return kernel;
+}
+
+static const BlendKernel &Kernel()
+{
+    static const BlendKernel kernel = SelectKernel();
+    return kernel;
+}
+
+const char *PRDMDCompositorKernelName()
+{
+    return Kernel().name;
+}
+
+PRDMDCompositor::PRDMDCompositor() : dirtyTop(0), dirtyBottom(0)
+{
+}
+
+int32_t PRDMDCompositor::CreateLayer(uint16_t width, uint8_t height, PRDMDLayerMode mode)
+{
+    if (layers.size() == maxDMDLayers)
+    {
+        PRSetLastErrorText("No more than %d DMD layers.", maxDMDLayers);
+        return -1;
+    }
+    if (width == 0 || height == 0 || mode < kPRDMDLayerOpaque || mode > kPRDMDLayerAlpha)
+    {
+        PRSetLastErrorText("Can't create a %dx%d DMD layer with mode %d.", width, height, mode);
+        return -1;
+    }
+
+    Layer layer;
+    layer.width = width;
+    layer.height = height;
+    layer.x = 0;
+    layer.y = 0;
+    layer.mode = mode;
+    layer.visible = true;
+    layer.pixels.assign(width * height, 0);
+    if (mode == kPRDMDLayerAlpha)
+        layer.alpha.assign(width * height, 255);
+    layers.push_back(layer);
+    MarkDirty(&layers.back());
+    return (int32_t)layers.size() - 1;
+}
+
+PRDMDCompositor::Layer *PRDMDCompositor::GetLayer(int32_t layer)
+{
+    if (layer < 0 || layer >= (int32_t)layers.size())
+    {
+        PRSetLastErrorText("No DMD layer %d.", layer);
+        return NULL;
+    }
+    return &layers[layer];
+}
+
+PRResult PRDMDCompositor::SetPixels(int32_t index, const uint8_t *pixels, uint32_t stride, uint8_t bitsPerPixel)
+{
+    Layer *layer = GetLayer(index);
+    if (layer == NULL)
+        return kPRFailure;
+    if (bitsPerPixel != 4 && bitsPerPixel != 8)
+    {
+        PRSetLastErrorText("DMD layer pixels have 4 or 8 bits, not %d.", bitsPerPixel);
+        return kPRFailure;
+    }
+
+    for (int y = 0; y < layer->height; y++)
+    {
+        uint8_t *row = &layer->pixels[y * layer->width];
+        const uint8_t *source = pixels + (size_t)y * stride;
+        if (bitsPerPixel == 8)
+        {
+            memcpy(row, source, layer->width);
+        }
+        else
+        {
+            // Stretch 0-15 over 0-255 so 4-bit layers blend with 8-bit ones.
+            for (int x = 0; x < layer->width; x++)
+                row[x] = (uint8_t)((source[x] & 0xF) * 17);
+        }
+    }
+    MarkDirty(layer);
+    return kPRSuccess;
+}
+
+PRResult PRDMDCompositor::SetAlpha(int32_t index, const uint8_t *alpha, uint32_t stride)
+{
+    Layer *layer = GetLayer(index);
+    if (layer == NULL)
+        return kPRFailure;
+    if (layer->mode != kPRDMDLayerAlpha)
+    {
+        PRSetLastErrorText("DMD layer %d has no alpha.", index);
+        return kPRFailure;
+    }
+
+    for (int y = 0; y < layer->height; y++)
+        memcpy(&layer->alpha[y * layer->width], alpha + (size_t)y * stride, layer->width);
+    MarkDirty(layer);
+    return kPRSuccess;
+}
+
+PRResult PRDMDCompositor::SetPosition(int32_t index, int16_t x, int16_t y)
+{
+    Layer *layer = GetLayer(index);
+    if (layer == NULL)
+        return kPRFailure;
+    if (layer->x == x && layer->y == y)
+        return kPRSuccess;
+
+    // Both where it was and where it is now need redrawing.
+    MarkDirty(layer);
+    layer->x = x;
+    layer->y = y;
+    MarkDirty(layer);
+    return kPRSuccess;
+}
+
+PRResult PRDMDCompositor::SetVisible(int32_t index, bool visible)
+{
+    Layer *layer = GetLayer(index);
+    if (layer == NULL)
+        return kPRFailure;
+    if (layer->visible == visible)
+        return kPRSuccess;
+
+    layer->visible = visible;
+    // MarkDirty() skips hidden layers, but the area the layer is leaving
+    // has to be redrawn too.
+    layer->visible = true;
+    MarkDirty(layer);
+    layer->visible = visible;
+    return kPRSuccess;
+}
+
+void PRDMDCompositor::RemoveLayers()
+{
+    layers.clear();
+    Invalidate();
+}
+
+void PRDMDCompositor::MarkDirty(const Layer *layer)
+{
+    if (!layer->visible)
+        return;
+    int32_t top = layer->y;
+    int32_t bottom = layer->y + layer->height;
+    if (dirtyTop >= dirtyBottom)
+    {
+        dirtyTop = top;
+        dirtyBottom = bottom;
+    }
+    else
+    {
+        dirtyTop = std::min(dirtyTop, top);
+        dirtyBottom = std::max(dirtyBottom, bottom);
+    }
+}
+
+void PRDMDCompositor::Invalidate()
+{
+    dirtyTop = INT32_MIN;
+    dirtyBottom = INT32_MAX;
+}
+
+bool PRDMDCompositor::Composite(uint8_t *frame, int numColumns, int numRows)
+{
+    int32_t top = std::max<int32_t>(dirtyTop, 0);
+    int32_t bottom = std::min<int32_t>(dirtyBottom, numRows);
+    if (dirtyTop >= dirtyBottom)
+        return false;
+    dirtyTop = dirtyBottom = 0;
+    if (top >= bottom)
+        return false;
+
+    const BlendKernel &kernel = Kernel();
+    memset(frame + top * numColumns, 0, (bottom - top) * numColumns);
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const Layer &layer = layers[i];
+        int32_t y0 = std::max<int32_t>(top, layer.y);
+        int32_t y1 = std::min<int32_t>(bottom, layer.y + layer.height);
+        int32_t x0 = std::max<int32_t>(0, layer.x);
+        int32_t x1 = std::min<int32_t>(numColumns, layer.x + layer.width);
+        if (!layer.visible || y0 >= y1 || x0 >= x1)
+            continue;
+
+        for (int32_t y = y0; y < y1; y++)
+        {
+            size_t offset = (size_t)(y - layer.y) * layer.width + (x0 - layer.x);
+            uint8_t *dst = frame + y * numColumns + x0;
+            const uint8_t *src = &layer.pixels[offset];
+            switch (layer.mode)
+            {
+                case kPRDMDLayerOpaque:
+                    memcpy(dst, src, x1 - x0);
+                    break;
+                case kPRDMDLayerMasked:
+                    kernel.mask(dst, src, x1 - x0);
+                    break;
+                case kPRDMDLayerAlpha:
+                    kernel.alpha(dst, src, &layer.alpha[offset], x1 - x0);
+                    break;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,91 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDCompositor.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRDMDCOMPOSITOR_H
+#define PINPROC_PRDMDCOMPOSITOR_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <vector>
+#include "pinproc.h"
+
+#define maxDMDLayers (16)
+
+/**
+ * Stack of 8-bit layers blended into one frame of 8-bit pixels for
+ * DMDDrawPixels().  Layer 0 is at the bottom, over a black background.
+ *
+ * Every change marks the rows it touches; Composite() redraws only those
+ * rows, from the background up, and does nothing at all if no layer changed.
+ */
+class PRDMDCompositor
+{
+public:
+    PRDMDCompositor();
+
+    /** Returns the new layer's index, or -1 with the error text set. */
+    int32_t CreateLayer(uint16_t width, uint8_t height, PRDMDLayerMode mode);
+    PRResult SetPixels(int32_t layer, const uint8_t *pixels, uint32_t stride, uint8_t bitsPerPixel);
+    PRResult SetAlpha(int32_t layer, const uint8_t *alpha, uint32_t stride);
+    PRResult SetPosition(int32_t layer, int16_t x, int16_t y);
+    PRResult SetVisible(int32_t layer, bool visible);
+    void RemoveLayers();
+
+    /** Marks the whole frame for redrawing, e.g. after the DMD geometry changed. */
+    void Invalidate();
+    /** Redraws the changed rows of frame; returns false if nothing changed. */
+    bool Composite(uint8_t *frame, int numColumns, int numRows);
+
+private:
+    struct Layer
+    {
+        uint16_t width;
+        uint8_t height;
+        int16_t x;
+        int16_t y;
+        PRDMDLayerMode mode;
+        bool visible;
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> alpha; /**< Only for kPRDMDLayerAlpha. */
+    };
+
+    Layer *GetLayer(int32_t layer);
+    void MarkDirty(const Layer *layer);
+
+    std::vector<Layer> layers;
+    int32_t dirtyTop;    /**< First row to redraw. */
+    int32_t dirtyBottom; /**< Row after the last to redraw; <= dirtyTop if none. */
+};
+
+/** Name of the blend kernel the compositor uses: "avx2", "sse2", "neon" or "scalar". */
+const char *PRDMDCompositorKernelName();
+
+#endif /* PINPROC_PRDMDCOMPOSITOR_H */
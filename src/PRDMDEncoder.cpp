@@ -0,0 +1,213 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDEncoder.cpp
+ *  libpinproc
+ */
+
+#include "PRDMDEncoder.h"
+#include "PRCommon.h"
+#include "PRCPU.h"
+#if defined(PR_ARCH_X86)
+#include <immintrin.h>
+#endif
+#if defined(PR_ARCH_NEON)
+#include <arm_neon.h>
+#endif
+
+// The encoder works a row at a time: map the row's pixels into a scratch
+// row, then transpose it so that bit n of every eight mapped pixels becomes
+// one byte of plane n.  On x86 the transpose is a shift and a movemask per
+// plane for each 16 or 32 pixels.
+
+#define maxRowPixels (kPRDMDMaxEncodeColumns)
+
+typedef void (*PackRowFn)(uint8_t *const *planes, const uint8_t *mapped, int first, int numColumns, int numSubFrames);
+
+static void PackGroupsScalar(uint8_t *const *planes, const uint8_t *mapped, int first, int numColumns, int numSubFrames)
+{
+    for (int x = first; x < numColumns; x += 8)
+    {
+        for (int s = 0; s < numSubFrames; s++)
+        {
+            uint8_t byte = 0;
+            for (int i = 0; i < 8; i++)
+                byte |= ((mapped[x + i] >> s) & 1) << i;
+            planes[s][x / 8] = byte;
+        }
+    }
+}
+
+static void PackRowScalar(uint8_t *const *planes, const uint8_t *mapped, int first, int numColumns, int numSubFrames)
+{
+    PackGroupsScalar(planes, mapped, first, numColumns, numSubFrames);
+}
+
+#if defined(PR_ARCH_X86)
+// Shifting bit s of each byte up to bit 7 lets movemask gather it.  The
+// 16-bit shift carries bits across bytes, but only bit 7 of each is kept.
+PR_TARGET("sse2")
+static void PackRowSSE2(uint8_t *const *planes, const uint8_t *mapped, int first, int numColumns, int numSubFrames)
+{
+    int x = first;
+    for (; x + 16 <= numColumns; x += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(mapped + x));
+        for (int s = 0; s < numSubFrames; s++)
+        {
+            uint16_t bits = (uint16_t)_mm_movemask_epi8(_mm_sll_epi16(v, _mm_cvtsi32_si128(7 - s)));
+            planes[s][x / 8] = (uint8_t)bits;
+            planes[s][x / 8 + 1] = (uint8_t)(bits >> 8);
+        }
+    }
+    PackGroupsScalar(planes, mapped, x, numColumns, numSubFrames);
+}
+
+PR_TARGET("avx2")
+static void PackRowAVX2(uint8_t *const *planes, const uint8_t *mapped, int first, int numColumns, int numSubFrames)
+{
+    int x = first;
+    for (; x + 32 <= numColumns; x += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(mapped + x));
+        for (int s = 0; s < numSubFrames; s++)
+        {
+            uint32_t bits = (uint32_t)_mm256_movemask_epi8(_mm256_sll_epi16(v, _mm_cvtsi32_si128(7 - s)));
+            planes[s][x / 8] = (uint8_t)bits;
+            planes[s][x / 8 + 1] = (uint8_t)(bits >> 8);
+            planes[s][x / 8 + 2] = (uint8_t)(bits >> 16);
+            planes[s][x / 8 + 3] = (uint8_t)(bits >> 24);
+        }
+    }
+    PackRowSSE2(planes, mapped, x, numColumns, numSubFrames);
+}
+#endif
+
+#if defined(PR_ARCH_NEON)
+// NEON has no movemask: isolate bit s of each byte, move it to the byte's
+// lane position within its group of eight, and add each group up.
+static void PackRowNEON(uint8_t *const *planes, const uint8_t *mapped, int first, int numColumns, int numSubFrames)
+{
+    static const int8_t laneShifts[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7 };
+    const int8x16_t toLane = vld1q_s8(laneShifts);
+    const uint8x16_t one = vdupq_n_u8(1);
+    int x = first;
+    for (; x + 16 <= numColumns; x += 16)
+    {
+        uint8x16_t v = vld1q_u8(mapped + x);
+        for (int s = 0; s < numSubFrames; s++)
+        {
+            uint8x16_t bits = vshlq_u8(vandq_u8(vshlq_u8(v, vdupq_n_s8((int8_t)-s)), one), toLane);
+            uint8x8_t sums = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+            sums = vpadd_u8(sums, sums);
+            sums = vpadd_u8(sums, sums);
+            planes[s][x / 8] = vget_lane_u8(sums, 0);
+            planes[s][x / 8 + 1] = vget_lane_u8(sums, 1);
+        }
+    }
+    PackGroupsScalar(planes, mapped, x, numColumns, numSubFrames);
+}
+#endif
+
+struct PackKernel
+{
+    PackRowFn fn;
+    const char *name;
+};
+
+static PackKernel SelectKernel()
+{
+    PackKernel kernel = { PackRowScalar, "scalar" };
+    uint32_t features = PRCPUFeatures();
+    (void)features;
+#if defined(PR_ARCH_X86)
+    if (features & kPRCPUAVX2)
+    {
+        kernel.fn = PackRowAVX2;
+        kernel.name = "avx2";
+    }
+    else if (features & kPRCPUSSE2)
+    {
+        kernel.fn = PackRowSSE2;
+        kernel.name = "sse2";
+    }
+#endif
+#if defined(PR_ARCH_NEON)
+    if (features & kPRCPUNEON)
+    {
+        kernel.fn = PackRowNEON;
+        kernel.name = "neon";
+    }
+#endif
+    return kernel;
+}
+
+static const PackKernel &Kernel()
+{
+    static const PackKernel kernel = SelectKernel();
+    return kernel;
+}
+
+PRResult PRDMDEncodePlanes(uint8_t *dots, const uint8_t *pixels, uint32_t stride,
+                           int numColumns, int numRows, int numSubFrames, const uint8_t *colorMap)
+{
+    if (numColumns % 8 != 0 || numColumns > maxRowPixels)
+    {
+        PRSetLastErrorText("Can't encode %d columns; the count must be a multiple of 8 up to %d.", numColumns, maxRowPixels);
+        return kPRFailure;
+    }
+    if (numSubFrames < 1 || numSubFrames > 8)
+    {
+        PRSetLastErrorText("Can't encode %d subframes; the limit is 8.", numSubFrames);
+        return kPRFailure;
+    }
+
+    PackRowFn packRow = Kernel().fn;
+    int bytesPerRow = numColumns / 8;
+    int bytesPerPlane = bytesPerRow * numRows;
+    uint8_t mapped[maxRowPixels];
+    uint8_t *planes[8];
+
+    for (int y = 0; y < numRows; y++)
+    {
+        const uint8_t *row = pixels + (size_t)y * stride;
+        if (colorMap != NULL)
+        {
+            for (int x = 0; x < numColumns; x++)
+                mapped[x] = colorMap[row[x]];
+            row = mapped;
+        }
+        for (int s = 0; s < numSubFrames; s++)
+            planes[s] = dots + s * bytesPerPlane + y * bytesPerRow;
+        packRow(planes, row, 0, numColumns, numSubFrames);
+    }
+    return kPRSuccess;
+}
+
+const char *PRDMDEncoderKernelName()
+{
+    return Kernel().name;
+}
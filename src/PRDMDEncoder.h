@@ -0,0 +1,56 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDEncoder.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRDMDENCODER_H
+#define PINPROC_PRDMDENCODER_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+#include "pinproc.h"
+
+/**
+ * Converts a frame of 8-bit pixels into the dot layout DMDDraw() sends:
+ * numSubFrames planes, each numRows rows of numColumns / 8 bytes, with the
+ * leftmost dot of each byte in bit 0.
+ *
+ * Each pixel is looked up in colorMap (256 entries; NULL if the pixels are
+ * already mapped) and bit n of the result lights the dot in subframe n.
+ * numColumns must be a multiple of 8 and numSubFrames at most 8; anything
+ * else fails with the error text set.  The bit transpose runs with the
+ * widest kernel PRCPUFeatures() allows.
+ */
+PRResult PRDMDEncodePlanes(uint8_t *dots, const uint8_t *pixels, uint32_t stride,
+                       int numColumns, int numRows, int numSubFrames, const uint8_t *colorMap);
+
+/** Name of the kernel PRDMDEncodePlanes() uses: "avx2", "sse2", "neon" or "scalar". */
+const char *PRDMDEncoderKernelName();
+
+#endif /* PINPROC_PRDMDENCODER_H */
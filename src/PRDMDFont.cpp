@@ -0,0 +1,148 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDFont.cpp
+ *  libpinproc
+ */
+
+#include "PRDMDFont.h"
+#include "PRCommon.h"
+#include <string.h>
+
+PRDMDFont::PRDMDFont(uint8_t height, uint8_t numSubFrames, uint8_t spacing) :
+    height(height), numSubFrames(numSubFrames), spacing(spacing)
+{
+    memset(glyphs, 0x00, sizeof(glyphs));
+}
+
+PRDMDFont *PRDMDFont::Create(uint8_t height, uint8_t numSubFrames, uint8_t spacing)
+{
+    if (height == 0 || numSubFrames < 1 || numSubFrames > 8)
+    {
+        PRSetLastErrorText("Can't create a DMD font %d rows high with %d subframes.", height, numSubFrames);
+        return NULL;
+    }
+    return new PRDMDFont(height, numSubFrames, spacing);
+}
+
+PRResult PRDMDFont::AddGlyph(uint8_t character, const uint8_t *pixels, uint8_t width, uint32_t stride, const uint8_t *colorMap)
+{
+    if (width == 0 || width > maxGlyphWidth)
+    {
+        PRSetLastErrorText("DMD glyphs are 1 to %d columns wide, not %d.", maxGlyphWidth, width);
+        return kPRFailure;
+    }
+
+    // Every slot holds a glyph of any width, so a replacement reuses the
+    // old one and only a new glyph goes on the end of the atlas.
+    Glyph *glyph = &glyphs[character];
+    uint32_t numWords = height * (numSubFrames + 1);
+    if (glyph->width == 0)
+    {
+        glyph->offset = (uint32_t)atlas.size();
+        atlas.resize(atlas.size() + numWords);
+    }
+    glyph->width = width;
+
+    uint32_t *mask = &atlas[glyph->offset];
+    uint32_t *planes = mask + height;
+    memset(mask, 0x00, numWords * sizeof(uint32_t));
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *row = pixels + (size_t)y * stride;
+        for (int x = 0; x < width; x++)
+        {
+            // Like the default color map, gray pixels keep their top bits.
+            uint8_t bits = colorMap != NULL ? colorMap[row[x]] : (uint8_t)(row[x] >> (8 - numSubFrames));
+            if (bits == 0)
+                continue;
+            mask[y] |= 1u << x;
+            for (int s = 0; s < numSubFrames; s++)
+                if ((bits >> s) & 1)
+                    planes[s * height + y] |= 1u << x;
+        }
+    }
+    return kPRSuccess;
+}
+
+int32_t PRDMDFont::DrawText(uint8_t *dots, uint16_t numColumns, uint8_t numRows, int32_t x, int32_t y, const char *text) const
+{
+    int32_t bytesPerRow = numColumns / 8;
+    for (const uint8_t *c = (const uint8_t *)text; *c != 0; c++)
+    {
+        const Glyph &glyph = glyphs[*c];
+        if (glyph.width == 0)
+            continue;
+        if (x < numColumns && x + glyph.width > 0 && y < numRows && y + height > 0)
+            DrawGlyph(dots, bytesPerRow, numRows, x, y, glyph);
+        x += glyph.width + spacing;
+    }
+    return x;
+}
+
+int32_t PRDMDFont::TextWidth(const char *text) const
+{
+    int32_t width = 0;
+    for (const uint8_t *c = (const uint8_t *)text; *c != 0; c++)
+        if (glyphs[*c].width != 0)
+            width += glyphs[*c].width + spacing;
+    return width > 0 ? width - spacing : 0;
+}
+
+void PRDMDFont::DrawGlyph(uint8_t *dots, int32_t bytesPerRow, int32_t numRows, int32_t x, int32_t y, const Glyph &glyph) const
+{
+    // Byte stores may alias anything, so keep the font's fields in locals.
+    const int32_t glyphHeight = height;
+    const int32_t glyphPlanes = numSubFrames;
+    const uint32_t *mask = &atlas[glyph.offset];
+    const uint32_t *planes = mask + glyphHeight;
+    const int32_t bytesPerPlane = bytesPerRow * numRows;
+    // Columns left of the display are shifted out; otherwise the row starts
+    // (x & 7) bits into byte x / 8.  Either way it covers at most 5 bytes.
+    const int32_t firstByte = x >= 0 ? x / 8 : 0;
+    const int32_t shiftLeft = x >= 0 ? x & 7 : 0;
+    const int32_t shiftRight = x >= 0 ? 0 : -x;
+    int32_t numBytes = (shiftLeft + glyph.width - shiftRight + 7) / 8;
+    if (numBytes > bytesPerRow - firstByte)
+        numBytes = bytesPerRow - firstByte;
+
+    for (int32_t r = 0; r < glyphHeight; r++)
+    {
+        int32_t row = y + r;
+        if (row < 0 || row >= numRows || mask[r] == 0)
+            continue;
+        uint64_t rowMask = ((uint64_t)mask[r] >> shiftRight) << shiftLeft;
+        uint8_t *dst = dots + row * bytesPerRow + firstByte;
+        for (int32_t s = 0; s < glyphPlanes; s++, dst += bytesPerPlane)
+        {
+            uint64_t rowBits = ((uint64_t)planes[s * glyphHeight + r] >> shiftRight) << shiftLeft;
+            // The glyph's own pixels replace what is under them; its blank
+            // pixels leave the frame alone.
+            for (int32_t b = 0; b < numBytes; b++)
+                dst[b] = (uint8_t)((dst[b] & ~(rowMask >> (8 * b))) | (rowBits >> (8 * b)));
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDFont.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRDMDFONT_H
+#define PINPROC_PRDMDFONT_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <vector>
+#include "pinproc.h"
+
+#define maxGlyphWidth (32)
+
+/**
+ * Glyphs cached in the bit-packed form of the DMD frame planes.  Each glyph
+ * row is a 32-bit word per subframe plus a coverage mask, with bit n being
+ * column n, matching the dots' leftmost-dot-in-bit-0 order.  Drawing a
+ * row shifts those words to the glyph's column and merges them into the
+ * few bytes of each plane the row touches.
+ */
+class PRDMDFont
+{
+public:
+    /** Returns NULL with the error text set if the parameters can't be used. */
+    static PRDMDFont *Create(uint8_t height, uint8_t numSubFrames, uint8_t spacing);
+
+    PRResult AddGlyph(uint8_t character, const uint8_t *pixels, uint8_t width, uint32_t stride, const uint8_t *colorMap);
+    /** Draws text with its top left corner at x, y; returns the x just past the last character. */
+    int32_t DrawText(uint8_t *dots, uint16_t numColumns, uint8_t numRows, int32_t x, int32_t y, const char *text) const;
+    int32_t TextWidth(const char *text) const;
+
+private:
+    PRDMDFont(uint8_t height, uint8_t numSubFrames, uint8_t spacing);
+
+    struct Glyph
+    {
+        uint8_t width;   /**< 0 if the character has no glyph. */
+        uint32_t offset; /**< First word in atlas: height mask words, then height words per subframe. */
+    };
+
+    void DrawGlyph(uint8_t *dots, int32_t bytesPerRow, int32_t numRows, int32_t x, int32_t y, const Glyph &glyph) const;
+
+    uint8_t height;
+    uint8_t numSubFrames;
+    uint8_t spacing;
+    Glyph glyphs[256];
+    std::vector<uint32_t> atlas;
+};
+
+#endif /* PINPROC_PRDMDFONT_H */
@@ -0,0 +1,137 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDTiming.cpp
+ *  libpinproc
+ */
+
+#include "PRDMDTiming.h"
+#include "PRCommon.h"
+#include "PRHardware.h"
+
+#define maxDEHighCycles (1023) // Width of the deHighCycles field.
+
+uint32_t PRDMDTimingWord(const PRDMDConfig *dmdConfig, int subFrame)
+{
+    return (dmdConfig->rclkLowCycles[subFrame] << P_ROC_DMD_RCLK_LOW_CYCLES_SHIFT) |
+           (dmdConfig->latchHighCycles[subFrame] << P_ROC_DMD_LATCH_HIGH_CYCLES_SHIFT) |
+           (dmdConfig->deHighCycles[subFrame] << P_ROC_DMD_DE_HIGH_CYCLES_SHIFT) |
+           (dmdConfig->dotclkHalfPeriod[subFrame] << P_ROC_DMD_DOTCLK_HALF_PERIOD_SHIFT);
+}
+
+uint64_t PRDMDFrameCycles(uint32_t numColumns, uint32_t numRows, uint32_t numSubFrames,
+                          const uint32_t *timingWords)
+{
+    uint64_t cycles = 0;
+    for (uint32_t i = 0; i < numSubFrames; i++)
+    {
+        uint32_t timing = timingWords[i < kPRDMDTimingRegisters ? i : kPRDMDTimingRegisters - 1];
+        uint32_t dotclk = (timing >> P_ROC_DMD_DOTCLK_HALF_PERIOD_SHIFT) & 0x3F;
+        uint32_t de = (timing >> P_ROC_DMD_DE_HIGH_CYCLES_SHIFT) & 0x3FF;
+        uint32_t latch = (timing >> P_ROC_DMD_LATCH_HIGH_CYCLES_SHIFT) & 0xFF;
+        uint32_t rclk = (timing >> P_ROC_DMD_RCLK_LOW_CYCLES_SHIFT) & 0xFF;
+        uint32_t shift = numColumns * 2 * (dotclk ? dotclk : 1);
+        cycles += (uint64_t)numRows * ((shift > de ? shift : de) + latch + rclk);
+    }
+    return cycles;
+}
+
+PRResult PRDMDOptimizeTiming(PRDMDConfig *dmdConfig, uint32_t refreshHz, uint32_t fpgaClockHz, PRDMDTiming *timing)
+{
+    uint32_t numSubFrames = dmdConfig->numSubFrames;
+    if (numSubFrames < 1 || numSubFrames > 8 || dmdConfig->numColumns == 0 || dmdConfig->numRows == 0 || refreshHz == 0)
+    {
+        PRSetLastErrorText("Can't time a %dx%d DMD with %d subframes at %d Hz.",
+                           dmdConfig->numColumns, dmdConfig->numRows, numSubFrames, refreshHz);
+        return kPRFailure;
+    }
+    if (fpgaClockHz == 0)
+        fpgaClockHz = kPRDMDFPGAClockHz;
+
+    // The panel's own limits come from the first entries if they are set.
+    uint8_t rclk = dmdConfig->rclkLowCycles[0] ? dmdConfig->rclkLowCycles[0] : 15;
+    uint8_t latch = dmdConfig->latchHighCycles[0] ? dmdConfig->latchHighCycles[0] : 15;
+    uint8_t dotclk = dmdConfig->dotclkHalfPeriod[0] ? dmdConfig->dotclkHalfPeriod[0] : 1;
+
+    // A dot's brightness is the sum of deHighCycles over the subframes it is
+    // lit in.  Doubling deHighCycles from one subframe to the next gives
+    // every bit pattern its own level.  Subframes past the last timing
+    // register share its weight.
+    uint32_t weights[8];
+    for (uint32_t i = 0; i < numSubFrames; i++)
+        weights[i] = 1u << (i < kPRDMDTimingRegisters ? i : kPRDMDTimingRegisters - 1);
+    uint32_t maxWeight = weights[numSubFrames - 1];
+
+    // Scale the weights up as far as the frame still fits in the refresh
+    // period: longer deHighCycles mean brighter dots, and the row shift
+    // overlaps with them for free.  If even the shortest doesn't fit, the
+    // shortest gives the fastest refresh there is.
+    uint64_t budget = fpgaClockHz / refreshHz;
+    uint32_t timingWords[kPRDMDTimingRegisters];
+    uint32_t unit;
+    uint64_t cycles = 0;
+    for (unit = maxDEHighCycles / maxWeight; unit >= 1; unit--)
+    {
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            dmdConfig->rclkLowCycles[i] = rclk;
+            dmdConfig->latchHighCycles[i] = latch;
+            dmdConfig->dotclkHalfPeriod[i] = dotclk;
+            dmdConfig->deHighCycles[i] = (uint16_t)(unit * weights[i < numSubFrames ? i : numSubFrames - 1]);
+        }
+        for (int i = 0; i < kPRDMDTimingRegisters; i++)
+            timingWords[i] = PRDMDTimingWord(dmdConfig, i);
+        cycles = PRDMDFrameCycles(dmdConfig->numColumns, dmdConfig->numRows, numSubFrames, timingWords);
+        if (cycles <= budget || unit == 1)
+            break;
+    }
+
+    // Count the distinct sums of subframe weights, which is 2^numSubFrames
+    // unless subframes share a register.
+    uint64_t reachable = 1; // Bit n: some set of subframes adds up to n.
+    for (uint32_t i = 0; i < numSubFrames; i++)
+        reachable |= reachable << weights[i];
+    uint32_t numLevels = 0;
+    for (; reachable != 0; reachable &= reachable - 1)
+        numLevels++;
+
+    // Each row is lit for its deHighCycles once per subframe.
+    uint64_t onCycles = 0;
+    for (uint32_t i = 0; i < numSubFrames; i++)
+        onCycles += dmdConfig->deHighCycles[i];
+
+    timing->framePeriodNs = (uint32_t)(cycles * 1000000000 / fpgaClockHz);
+    timing->frameRateMilliHz = (uint32_t)((uint64_t)fpgaClockHz * 1000 / cycles);
+    timing->numLevels = numLevels;
+    timing->onTimePermille = (uint32_t)(onCycles * 1000 / cycles);
+    if (cycles > budget)
+    {
+        PRSetLastErrorText("A %dx%d DMD with %d subframes refreshes at %d Hz at most.",
+                           dmdConfig->numColumns, dmdConfig->numRows, numSubFrames, timing->frameRateMilliHz / 1000);
+        return kPRFailure;
+    }
+    return kPRSuccess;
+}
@@ -0,0 +1,56 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRDMDTiming.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRDMDTIMING_H
+#define PINPROC_PRDMDTIMING_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+#include "pinproc.h"
+
+#define kPRDMDFPGAClockHz (50000000) // The DMD timing registers count cycles of this clock.
+#define kPRDMDTimingRegisters (4)    // Subframes past the last register reuse its timing.
+
+/** The timing register word for one subframe of dmdConfig, as CreateDMDUpdateConfigBurst() writes it. */
+uint32_t PRDMDTimingWord(const PRDMDConfig *dmdConfig, int subFrame);
+
+/**
+ * FPGA cycles one frame (every subframe of every row) takes.  Each row
+ * shifts in one dot per dotclk period while the previous row is lit for
+ * deHighCycles, then latches and strobes rclk.
+ */
+uint64_t PRDMDFrameCycles(uint32_t numColumns, uint32_t numRows, uint32_t numSubFrames,
+                          const uint32_t *timingWords);
+
+/** Fills in dmdConfig's timing for PRDMDComputeTiming(). */
+PRResult PRDMDOptimizeTiming(PRDMDConfig *dmdConfig, uint32_t refreshHz, uint32_t fpgaClockHz, PRDMDTiming *timing);
+
+#endif /* PINPROC_PRDMDTIMING_H */
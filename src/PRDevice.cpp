@@ -29,27 +29,62 @@
  */
 
 #include "PRDevice.h"
+#include "PRSimulator.h"
+#include "PRByteOrder.h"
+#include "PRDMDEncoder.h"
+#include "PRDMDAnimation.h"
 #include <stdlib.h>
 #include <string.h>
 #ifndef _MSC_VER
 #include <unistd.h>
+#include <fcntl.h>
 #endif
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include <algorithm>
+#include <chrono>
 #include <stdio.h>
 
-PRDevice::PRDevice(PRMachineType machineType) : machineType(machineType)
+PRDevice::PRDevice(PRMachineType machineType, PRTransport *transport, PRCreateOptions *options) : transport(transport), ioThreadRunning(false), ioThreadStop(false),
+    writeRing(NULL), requestedRing(NULL), eventRing(NULL), ioThreadDroppedEvents(0), ioThreadDroppedRequestedWords(0), ioThreadWordsReceived(0), ioThreadNewEvents(false), ioThreadNewRequested(false),
+    eventFDRead(-1), eventFDWrite(-1),
+    unrequestedDataQueue(options->eventQueueSize),
+    requestedDataQueue(std::max<uint32_t>(options->requestedDataQueueSize, minRequestedDataQueueSize)),
+    unrequestedStamps(options->eventQueueSize), pendingReadsHead(0), numPendingReads(0), numRoutedFrameWords(0),
+    collectTimeNs(0), nextEventSequence(0), lastDeviceTime(0),
+    machineType(machineType), dmdWriteBuffer(0), dmdDiffEnabled(false), dmdColorMapSet(false), dmdQueueHead(0), dmdQueueCount(0), dmdQueueCredits(1),
+    dmdAnimation(NULL), dmdAnimationLoop(false), dmdAnimationNext(0), dmdAnimationHold(0),
+    freeSwitchRuleIndexes(maxSwitchRules)
 {
+    SetEventFormat(0);
+    memset(&stats, 0x00, sizeof(PRStats));
+    memset(&dmdQueueStatus, 0x00, sizeof(PRDMDQueueStatus));
+    memset(&dmdConfig, 0x00, sizeof(PRDMDConfig)); // No frame events until DMDUpdateConfig().
+    memset(dmdQueueMissed, 0x00, sizeof(dmdQueueMissed));
+
     // Reset internally maintainted driver and switch structures, but do not update the device.
     Reset(kPRResetFlagDefault);
 }
 
 PRDevice::~PRDevice()
 {
+    StopIOThread();
     Close();
+    SetDMDAnimation(NULL);
+    delete transport;
 }
 
-PRDevice* PRDevice::Create(PRMachineType machineType)
+PRDevice* PRDevice::Create(PRMachineType machineType, PRCreateOptions *options)
 {
-    PRDevice *dev = new PRDevice(machineType);
+    PRTransport *transport = PRTransport::Create(options);
+    if (transport == NULL)
+    {
+        DEBUG(PRLog(kPRLogError, "Error creating transport for P-ROC device\n"));
+        return NULL;
+    }
+
+    PRDevice *dev = new PRDevice(machineType, transport, options);
 
     if (dev == NULL)
     {
@@ -67,8 +102,8 @@ PRDevice* PRDevice::Create(PRMachineType machineType)
 
     PRMachineType readMachineType = dev->GetReadMachineType();
 
-    // Custom is always accepted
-    if (machineType != kPRMachineCustom && machineType != kPRMachinePDB &&
+    // Custom is always accepted, and there's nothing to protect without hardware.
+    if (machineType != kPRMachineCustom && machineType != kPRMachinePDB && dev->transport->IsHardware() &&
 
 	// Don't accept if requested type is WPC/WPC95 but read machine is not.
         ( (((machineType == kPRMachineWPC) ||
@@ -89,6 +124,12 @@ PRDevice* PRDevice::Create(PRMachineType machineType)
         return NULL;
     }
 
+    if (options->useIOThread && dev->StartIOThread() != kPRSuccess)
+    {
+        delete dev;
+        return NULL;
+    }
+
     return dev;
 }
 
@@ -102,8 +143,10 @@ PRResult PRDevice::Reset(uint32_t resetFlags)
     num_collected_bytes = 0;
 
     // Make sure the data queues are empty.
-    while (!unrequestedDataQueue.empty()) unrequestedDataQueue.pop();
-    while (!requestedDataQueue.empty()) requestedDataQueue.pop();
+    unrequestedDataQueue.Clear();
+    unrequestedStamps.Clear();
+    requestedDataQueue.Clear();
+    AbandonPendingReads(true);
     num_collected_bytes = 0;
     numPreparedWriteWords = 0;
 
@@ -119,8 +162,11 @@ PRResult PRDevice::Reset(uint32_t resetFlags)
     }
 #endif
 
+    // Nothing is known about the PD-LED boards until they're written again.
+    LEDShadowReset();
+
     // Make sure the free list is empty.
-    while (!freeSwitchRuleIndexes.empty()) freeSwitchRuleIndexes.pop();
+    freeSwitchRuleIndexes.Clear();
 
 	memset(switchRules, 0x00, sizeof(PRSwitchRuleInternal) * maxSwitchRules);
 
@@ -139,7 +185,7 @@ PRResult PRDevice::Reset(uint32_t resetFlags)
         if (switchRule->switchNum >= kPRSwitchNeverDebounceFirst &&
             (switchRule->eventType == kPREventTypeSwitchClosedDebounced ||
              switchRule->eventType == kPREventTypeSwitchOpenDebounced))
-            freeSwitchRuleIndexes.push(ruleIndex);
+            freeSwitchRuleIndexes.Push(ruleIndex);
     }
 
     // Create empty switch rule for clearing the rules in the device.
@@ -163,102 +209,203 @@ PRResult PRDevice::Reset(uint32_t resetFlags)
 
 int PRDevice::GetEvents(PREvent *events, int maxEvents)
 {
+    if (ioThreadRunning)
+    {
+        // The I/O thread has already collected and decoded the events.
+        // Clear the fd before popping so an event pushed in between leaves
+        // it readable, and re-arm it if maxEvents left some behind.
+        ClearEventSignal();
+        int numEvents = 0;
+        const PREventEx *eventsEx;
+        int count;
+        while (numEvents < maxEvents && (count = eventRing->Peek(&eventsEx)) > 0)
+        {
+            count = std::min(count, maxEvents - numEvents);
+            for (int i = 0; i < count; i++, numEvents++)
+            {
+                events[numEvents].type = eventsEx[i].type;
+                events[numEvents].value = eventsEx[i].value;
+                events[numEvents].time = eventsEx[i].time;
+            }
+            eventRing->Consume(count);
+        }
+        if (eventRing->Size() > 0)
+            SignalEvents();
+        DMDQueueNoteEvents(events, numEvents);
+        return numEvents;
+    }
+
     if (SortReturningData() != kPRSuccess)
     {
         PRSetLastErrorText("GetEvents ERROR: Error in CollectReadData");
 	    return -1;
     }
 
-    // The unrequestedDataQueue only has unrequested switch event data.  Pop
-    // events out 1 at a time, interpret them, and populate the outgoing list with them.
-    int i;
-    for (i = 0; (i < maxEvents) && !unrequestedDataQueue.empty(); i++)
+    // The unrequestedDataQueue only has unrequested switch event data.  Decode
+    // it where it sits, straight into the outgoing list; the waiting words are
+    // in at most two contiguous runs.  The times still go through
+    // UnwrapEventTime() so PRGetEventsEx() stays correct if both are used.
+    int numEvents = 0;
+    const uint32_t *words;
+    int numWords;
+    while (numEvents < maxEvents && (numWords = unrequestedDataQueue.Peek(&words)) > 0)
     {
-        uint32_t event_data = unrequestedDataQueue.front();
-        unrequestedDataQueue.pop();
+        numWords = std::min(numWords, maxEvents - numEvents);
+        decodeEvents(events + numEvents, words, numWords);
+        unrequestedDataQueue.Consume(numWords);
+        unrequestedStamps.Consume(numWords);
+        for (int i = 0; i < numWords; i++, numEvents++)
+            UnwrapEventTime(&events[numEvents]);
+    }
+    DMDQueueNoteEvents(events, numEvents);
+    return numEvents;
+}
 
-        int type;
-        bool open, debounced;
+int PRDevice::GetEventsEx(PREventEx *events, int maxEvents)
+{
+    if (ioThreadRunning)
+    {
+        // Same as GetEvents(); the ring already holds PREventEx.
+        ClearEventSignal();
+        int numEvents = eventRing->Pop(events, maxEvents);
+        if (eventRing->Size() > 0)
+            SignalEvents();
+        DMDQueueNoteEvents(events, numEvents);
+        return numEvents;
+    }
 
-        if (version >= 2) {
-            events[i].value = event_data & P_ROC_V2_EVENT_SWITCH_NUM_MASK;
-            type = (event_data & P_ROC_V2_EVENT_TYPE_MASK) >> P_ROC_V2_EVENT_TYPE_SHIFT;
-            open = (event_data & P_ROC_V2_EVENT_SWITCH_STATE_MASK) >> P_ROC_V2_EVENT_SWITCH_STATE_SHIFT;
-            debounced = (event_data & P_ROC_V2_EVENT_SWITCH_DEBOUNCED_MASK) >> P_ROC_V2_EVENT_SWITCH_DEBOUNCED_SHIFT;
-            events[i].time = (event_data & P_ROC_V2_EVENT_SWITCH_TIMESTAMP_MASK) >> P_ROC_V2_EVENT_SWITCH_TIMESTAMP_SHIFT;
-        }
-        else {
-            type = (event_data & P_ROC_V1_EVENT_TYPE_MASK) >> P_ROC_V1_EVENT_TYPE_SHIFT;
-            events[i].value = event_data & P_ROC_V1_EVENT_SWITCH_NUM_MASK;
-            open = (event_data & P_ROC_V1_EVENT_SWITCH_STATE_MASK) >> P_ROC_V1_EVENT_SWITCH_STATE_SHIFT;
-            debounced = (event_data & P_ROC_V1_EVENT_SWITCH_DEBOUNCED_MASK) >> P_ROC_V1_EVENT_SWITCH_DEBOUNCED_SHIFT;
-            events[i].time = (event_data & P_ROC_V1_EVENT_SWITCH_TIMESTAMP_MASK) >> P_ROC_V1_EVENT_SWITCH_TIMESTAMP_SHIFT;
-        }
+    if (SortReturningData() != kPRSuccess)
+    {
+        PRSetLastErrorText("GetEventsEx ERROR: Error in CollectReadData");
+	    return -1;
+    }
 
+    const int batchSize = 64;
+    PREvent decoded[batchSize];
+    PREventStamp stamps[batchSize];
+    int numEvents = 0;
+    const uint32_t *words;
+    int numWords;
+    while (numEvents < maxEvents && (numWords = unrequestedDataQueue.Peek(&words)) > 0)
+    {
+        numWords = std::min(std::min(numWords, maxEvents - numEvents), batchSize);
+        decodeEvents(decoded, words, numWords);
+        unrequestedDataQueue.Consume(numWords);
+        unrequestedStamps.Pop(stamps, numWords);
+        for (int i = 0; i < numWords; i++, numEvents++)
+            FillEventEx(&events[numEvents], &decoded[i], &stamps[i]);
+    }
+    DMDQueueNoteEvents(events, numEvents);
+    return numEvents;
+}
 
-        //fprintf(stderr, "Libpinproc: event type: %d\n", type);
-        switch (type)
-        {
-            case P_ROC_EVENT_TYPE_SWITCH:
-            {
-                if (open)
-                    events[i].type = debounced ? kPREventTypeSwitchOpenDebounced : kPREventTypeSwitchOpenNondebounced;
-                else
-                    events[i].type = debounced ? kPREventTypeSwitchClosedDebounced : kPREventTypeSwitchClosedNondebounced;
-                break;
-            }
+uint64_t PRDevice::UnwrapEventTime(const PREvent *event)
+{
+    // The device sends events in time order, so the timeline only moves
+    // forward.  Accelerometer timestamps are narrower than switch timestamps,
+    // so each event is unwrapped at its own width against the shared timeline.
+    lastDeviceTime += (event->time - lastDeviceTime) & eventTimeMasks[event->type];
+    return lastDeviceTime;
+}
 
-            case P_ROC_EVENT_TYPE_DMD:
-            {
-                events[i].type = kPREventTypeDMDFrameDisplayed;
-                break;
-            }
+void PRDevice::SetEventFormat(uint16_t version)
+{
+    decodeEvents = PREventDecoderForVersion(version);
+    for (int type = 0; type <= kPREventTypeAccelerometerIRQ; type++)
+        eventTimeMasks[type] = (uint32_t)((1ULL << PREventTimeBits(version, (PREventType)type)) - 1);
+}
 
-            case P_ROC_EVENT_TYPE_BURST_SWITCH:
-            {
-                //fprintf(stderr, "Burst event\n");
-                if (open) events[i].type = kPREventTypeBurstSwitchOpen;
-                else events[i].type = kPREventTypeBurstSwitchClosed;
-                break;
-            }
+void PRDevice::FillEventEx(PREventEx *eventEx, const PREvent *event, const PREventStamp *stamp)
+{
+    eventEx->type = event->type;
+    eventEx->value = event->value;
+    eventEx->time = event->time;
+    eventEx->deviceTime = UnwrapEventTime(event);
+    eventEx->hostTimeNs = stamp->hostTimeNs;
+    eventEx->sequence = stamp->sequence;
+}
 
-            case P_ROC_EVENT_TYPE_ACCELEROMETER:
-            {
-                events[i].time = events[i].time >> 2;
-                events[i].value = event_data & 0x00003FFF;
-                int accel_type = (event_data & 0x00030000) >> 16;
-                switch (accel_type)
-                {
-                    case 0:
-                    {
-                        events[i].type = kPREventTypeAccelerometerX;
-                        break;
-                    }
-                    case 1:
-                    {
-                        events[i].type = kPREventTypeAccelerometerY;
-                        break;
-                    }
-                    case 2:
-                    {
-                        events[i].type = kPREventTypeAccelerometerZ;
-                        break;
-                    }
-                    case 3:
-                    {
-                        events[i].type = kPREventTypeAccelerometerIRQ;
-                        break;
-                    }
-                    default: events[i].type = kPREventTypeInvalid;
-                }
-                break;
-            }
+int PRDevice::WaitForEvents(uint32_t timeoutUs)
+{
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
 
-            default: events[i].type = kPREventTypeInvalid;
+    if (ioThreadRunning)
+    {
+        std::unique_lock<std::mutex> lock(eventMutex);
+        eventCond.wait_until(lock, deadline, [this] { return eventRing->Size() > 0; });
+        return eventRing->Size();
+    }
 
-        }
+    // Without an I/O thread nothing reads the transport in the background,
+    // so poll it at a much finer interval than callers' usual 10 ms sleep.
+    while (true)
+    {
+        if (SortReturningData() != kPRSuccess)
+            return -1;
+        if (unrequestedDataQueue.Size() > 0)
+            return (int)unrequestedDataQueue.Size();
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+            return 0;
+        std::chrono::microseconds remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now);
+        std::this_thread::sleep_for(std::min(remaining, std::chrono::microseconds(waitForEventsPollUs)));
+    }
+}
+
+int PRDevice::GetEventFD()
+{
+    if (!ioThreadRunning)
+    {
+        PRSetLastErrorText("PRGetEventFD() requires a handle created with useIOThread");
+        return -1;
+    }
+    if (eventFDRead < 0)
+        PRSetLastErrorText("Event file descriptors are not supported on this platform");
+    return eventFDRead;
+}
+
+PRResult PRDevice::GetStats(PRStats *stats)
+{
+    *stats = this->stats;
+    stats->eventsDropped += ioThreadDroppedEvents.load(std::memory_order_relaxed);
+    stats->requestedWordsDropped += ioThreadDroppedRequestedWords.load(std::memory_order_relaxed);
+    return kPRSuccess;
+}
+
+void PRDevice::SignalEvents()
+{
+    {
+        std::lock_guard<std::mutex> lock(eventMutex);
+    }
+    eventCond.notify_all();
+
+#ifndef _MSC_VER
+    if (eventFDWrite >= 0)
+    {
+#ifdef __linux__
+        uint64_t one = 1;
+        ssize_t rc = write(eventFDWrite, &one, sizeof(one));
+#else
+        uint8_t one = 1;
+        ssize_t rc = write(eventFDWrite, &one, sizeof(one));
+#endif
+        (void)rc; // A full pipe or saturated counter is still readable.
+    }
+#endif
+}
+
+void PRDevice::ClearEventSignal()
+{
+#ifndef _MSC_VER
+    if (eventFDRead >= 0)
+    {
+        uint8_t buffer[64];
+        while (read(eventFDRead, buffer, sizeof(buffer)) > 0)
+            ;
     }
-    return i;
+#endif
 }
 
 PRResult PRDevice::ManagerUpdateConfig(PRManagerConfig *managerConfig)
@@ -637,9 +784,9 @@ PRResult PRDevice::SwitchUpdateRule(uint8_t switchNum, PREventType eventType, PR
 
     // If more the base rule will link to others, ensure free indexes exists for
     // the links.
-    if (numDrivers > 0 && freeSwitchRuleIndexes.size() < (uint32_t)(numDrivers-1)) // -1 because the first switch rule holds the first driver.
+    if (numDrivers > 0 && freeSwitchRuleIndexes.Size() < (uint32_t)(numDrivers-1)) // -1 because the first switch rule holds the first driver.
     {
-        PRSetLastErrorText("Not enough free switch rule indexes: %d available, need %d", freeSwitchRuleIndexes.size(), numDrivers);
+        PRSetLastErrorText("Not enough free switch rule indexes: %d available, need %d", freeSwitchRuleIndexes.Size(), numDrivers);
         return kPRFailure;
     }
 
@@ -655,9 +802,9 @@ PRResult PRDevice::SwitchUpdateRule(uint8_t switchNum, PREventType eventType, PR
 	// Save old link index so it can freed after the linked rule is retrieved.
 	oldLinkIndex = oldRule->linkIndex;
         oldRule = GetSwitchRuleByIndex(oldRule->linkIndex);
-        freeSwitchRuleIndexes.push(oldLinkIndex);
+        freeSwitchRuleIndexes.Push(oldLinkIndex);
 
-        if (freeSwitchRuleIndexes.size() > 128) // Detect a corrupted link-related values before it eats up all of the memory.
+        if (freeSwitchRuleIndexes.Size() > 128) // Detect a corrupted link-related values before it eats up all of the memory.
         {
 			PRSetLastErrorText("Too many free switch rule indicies!");
             return kPRFailure;
@@ -684,8 +831,9 @@ PRResult PRDevice::SwitchUpdateRule(uint8_t switchNum, PREventType eventType, PR
         {
             if (numDrivers > 1)
             {
-                ruleIndex = freeSwitchRuleIndexes.front();
-                freeSwitchRuleIndexes.pop();
+                uint16_t freeIndex = 0;
+                freeSwitchRuleIndexes.Pop(freeIndex);
+                ruleIndex = freeIndex;
                 newRule = GetSwitchRuleByIndex(ruleIndex);
                 newRule->driver = linkedDrivers[0];
                 newRule->changeOutput = true;
@@ -765,97 +913,80 @@ PRResult PRDevice::SwitchUpdateRule(uint8_t switchNum, PREventType eventType, PR
     return res;
 }
 
-PRResult PRDevice::SwitchGetStates( PREventType * switchStates, uint16_t numSwitches )
+// Maps 4 state bits (low nibble of the index) and the matching 4 debounce bits
+// (high nibble) to four finished entries: a set state bit is open and a set
+// debounce bit is debounced.
+struct SwitchNibbleTable
 {
-    uint32_t stateWord, debounceWord;
-    uint8_t i, j;
-    PREventType eventType;
-
-    // Request one state word and one debounce word at a time.  Could make more efficient
-    // use of the USB bus by requesting a burst of state words and then a burst of debounce
-    // words, but doing one word at a time makes it easier to process each switch when the
-    // data returns.  Also, this function shouldn't be called during timing sensitive
-    // situations; so the inefficiencies are acceptable.
-    for (i = 0; i < numSwitches / 32; i++)
+    PREventType entries[256][4];
+    SwitchNibbleTable()
     {
-
-        if (chip_id == P_ROC_CHIP_ID)
+        for (int index = 0; index < 256; index++)
         {
-            RequestData(P_ROC_BUS_SWITCH_CTRL_SELECT,
-                        P_ROC_SWITCH_CTRL_STATE_BASE_ADDR + i, 1);
-
-            if (combinedVersionRevision < P_ROC_VER_REV_FIXED_SWITCH_STATE_READS) {
-                RequestData(P_ROC_BUS_SWITCH_CTRL_SELECT,
-                            P_ROC_SWITCH_CTRL_OLD_DEBOUNCE_BASE_ADDR + i, 1);
-            }
-            else {
-                RequestData(P_ROC_BUS_SWITCH_CTRL_SELECT,
-                            P_ROC_SWITCH_CTRL_DEBOUNCE_BASE_ADDR + i, 1);
+            for (int bit = 0; bit < 4; bit++)
+            {
+                bool open = (index >> bit) & 1;
+                bool debounced = (index >> (4 + bit)) & 1;
+                if (open)
+                    entries[index][bit] = debounced ? kPREventTypeSwitchOpenDebounced : kPREventTypeSwitchOpenNondebounced;
+                else
+                    entries[index][bit] = debounced ? kPREventTypeSwitchClosedDebounced : kPREventTypeSwitchClosedNondebounced;
             }
         }
-        else // chip == P3_ROC_CHIP_ID)
-        {
-            RequestData(P_ROC_BUS_SWITCH_CTRL_SELECT,
-                        P3_ROC_SWITCH_CTRL_STATE_BASE_ADDR + i, 1);
-
-            RequestData(P_ROC_BUS_SWITCH_CTRL_SELECT,
-                        P3_ROC_SWITCH_CTRL_DEBOUNCE_BASE_ADDR + i, 1);
-        }
     }
+};
 
-    // Expect 4 words for each 32 switches.  The state and debounce words,
-    // and the address words for both.
-    uint16_t numWords = 4 * (numSwitches / 32);
-
-    i = 0; // Reset i so it can be used to prevent an infinite loop below
+PRResult PRDevice::SwitchGetStates( PREventType * switchStates, uint16_t numSwitches )
+{
+    const int maxStateWords = 64;
+    uint32_t stateWords[maxStateWords], debounceWords[maxStateWords];
+    uint32_t stateAddr, debounceAddr;
+    int i, j;
 
-    // Wait for data to return.  Give it 10 loops before giving up.
-    while (requestedDataQueue.size() < numWords && i++ < 10)
+    int numStateWords = (numSwitches + 31) / 32;
+    if (numStateWords > maxStateWords)
     {
-        PRSleep (10); // 10 milliseconds should be plenty of time.
-		if (SortReturningData() != kPRSuccess)
-		{
-			return kPRFailure;
-        }
+        PRSetLastErrorText("Can't read %d switches; the limit is %d.", numSwitches, maxStateWords * 32);
+        return kPRFailure;
     }
 
-    // Make sure all of the requested words are available before processing them.
-    // Too many words is just as bad as not enough words.
-    // If too many come back, can they be trusted?
-    if (requestedDataQueue.size() == numWords)
+    if (chip_id == P_ROC_CHIP_ID)
     {
-        // Process the returning words.
-        for (i = 0; i < numSwitches / 32; i++)
-        {
-            requestedDataQueue.pop(); // Ignore address word.  TODO: Verify this address word.
-            stateWord = requestedDataQueue.front(); // This is the switch state word.
-            requestedDataQueue.pop();
-            requestedDataQueue.pop(); // Ignore address word.  TODO: Verify this address word.
-            debounceWord = requestedDataQueue.front(); // This is the debounce word.
-            requestedDataQueue.pop();
-
-            // Loop through each bit of the words, combining them into an eventType
-            for (j = 0; j < 32; j++)
-            {
-                // Only process the number of switches requested via numSwitches
-                if ((i * 32) + j < numSwitches)
-                {
-                    if (stateWord >> j & 1)
-                        if (debounceWord >> j & 1) eventType = kPREventTypeSwitchOpenDebounced;
-                        else eventType = kPREventTypeSwitchOpenNondebounced;
-                    else if (debounceWord >> j & 1) eventType = kPREventTypeSwitchClosedDebounced;
-                    else eventType = kPREventTypeSwitchClosedNondebounced;
-                    switchStates[(i * 32) + j] = eventType;
-                }
-            }
-        }
-        return kPRSuccess;
+        stateAddr = P_ROC_SWITCH_CTRL_STATE_BASE_ADDR;
+        if (combinedVersionRevision < P_ROC_VER_REV_FIXED_SWITCH_STATE_READS)
+            debounceAddr = P_ROC_SWITCH_CTRL_OLD_DEBOUNCE_BASE_ADDR;
+        else
+            debounceAddr = P_ROC_SWITCH_CTRL_DEBOUNCE_BASE_ADDR;
     }
-    else
+    else // chip == P3_ROC_CHIP_ID)
     {
-        PRSetLastErrorText("Switch response length does not match.");
+        stateAddr = P3_ROC_SWITCH_CTRL_STATE_BASE_ADDR;
+        debounceAddr = P3_ROC_SWITCH_CTRL_DEBOUNCE_BASE_ADDR;
+    }
+
+    // One burst for all of the state words and one for all of the debounce words.
+    PRReadRequest requests[2] = {
+        { P_ROC_BUS_SWITCH_CTRL_SELECT, stateAddr, numStateWords, stateWords },
+        { P_ROC_BUS_SWITCH_CTRL_SELECT, debounceAddr, numStateWords, debounceWords },
+    };
+    if (ReadDataMulti(requests, 2) != kPRSuccess)
         return kPRFailure;
+
+    // Whole nibbles go straight in; the last partial one (if any) is trimmed to numSwitches.
+    static const SwitchNibbleTable nibbleTable;
+    int numNibbles = numSwitches / 4;
+    for (i = 0; i < numNibbles; i++)
+    {
+        int shift = (i & 7) * 4;
+        uint32_t index = ((stateWords[i >> 3] >> shift) & 0xF) | (((debounceWords[i >> 3] >> shift) & 0xF) << 4);
+        memcpy(&switchStates[i * 4], nibbleTable.entries[index], sizeof(nibbleTable.entries[0]));
+    }
+    for (j = numNibbles * 4; j < numSwitches; j++)
+    {
+        uint32_t index = ((stateWords[j >> 5] >> (j & 31)) & 1) | (((debounceWords[j >> 5] >> (j & 31)) & 1) << 4);
+        switchStates[j] = nibbleTable.entries[index][0];
     }
+    return kPRSuccess;
 }
 
 int32_t PRDevice::DMDUpdateConfig(PRDMDConfig *dmdConfig)
@@ -867,6 +998,22 @@ int32_t PRDevice::DMDUpdateConfig(PRDMDConfig *dmdConfig)
     this->dmdConfig = *dmdConfig;
     CreateDMDUpdateConfigBurst(burst, dmdConfig);
 
+    // Writing the config clears the frame buffers and resets the write
+    // pointer, so start DMDDraw() over with full frames.
+    int32_t words_per_frame = (dmdConfig->numColumns * dmdConfig->numRows) / 32 * dmdConfig->numSubFrames;
+    int32_t numBuffers = dmdConfig->numFrameBuffers > 0 ? dmdConfig->numFrameBuffers : 1;
+    dmdShadow.assign(numBuffers * words_per_frame, 0);
+    dmdShadowValid.assign(numBuffers, false);
+    dmdWriteBuffer = 0;
+    dmdPixelFrame.assign(words_per_frame * 4, 0);
+    if (!dmdColorMapSet)
+        SetDefaultDMDColorMap();
+    dmdQueueFrames.clear();
+    DMDQueueReset();
+    SetDMDAnimation(NULL);
+    dmdComposite.assign(dmdConfig->numColumns * dmdConfig->numRows, 0);
+    dmdCompositor.Invalidate();
+
     DEBUG(PRLog(kPRLogInfo, "Configuring DMD\n"));
     DEBUG(PRLog(kPRLogVerbose, "Words: %x %x %x %x %x %x %x\n",burst[0],burst[1],burst[2],burst[3],
                 burst[4],burst[5],burst[6]));
@@ -878,116 +1025,489 @@ int32_t PRDevice::DMDUpdateConfig(PRDMDConfig *dmdConfig)
 
 PRResult PRDevice::DMDDraw(uint8_t * dots)
 {
-    int32_t k; //i,x,y,j,k,m;
-    //uint8_t color;
-    uint16_t words_per_sub_frame = (dmdConfig.numColumns*dmdConfig.numRows) / 32;
-    uint16_t words_per_frame = words_per_sub_frame * dmdConfig.numSubFrames;
-    uint32_t dmd_command_buffer[1024];
-    uint32_t * p_dmd_frame_buffer_words;
+    int32_t words_per_sub_frame = (dmdConfig.numColumns*dmdConfig.numRows) / 32;
+    int32_t words_per_frame = words_per_sub_frame * dmdConfig.numSubFrames;
+    const uint32_t * p_dmd_frame_buffer_words = (const uint32_t *)dots;
+    const int32_t maxDMDBurstWords = maxWriteWords - 1;
+    int32_t numFullBursts = (words_per_frame + maxDMDBurstWords - 1) / maxDMDBurstWords;
+    uint64_t fullBytes = (uint64_t)(words_per_frame + numFullBursts) * 4;
+
+    if (words_per_frame == 0)
+        return kPRSuccess;
 
-    p_dmd_frame_buffer_words = (uint32_t *)dots;
+    if (!dmdDiffEnabled || dmdShadowValid.empty() || !dmdShadowValid[dmdWriteBuffer])
+    {
+        // The frame is swapped straight out of dots into the transport buffer,
+        // behind whatever writes were already prepared.  Frames bigger than one
+        // burst go out as consecutive bursts; the dot table is still written in
+        // order, so the frame completes on its last word as before.
+        for (int32_t offset = 0; offset < words_per_frame; offset += maxDMDBurstWords)
+        {
+            int32_t numWords = std::min<int32_t>(maxDMDBurstWords, words_per_frame - offset);
+            uint32_t header = CreateBurstCommand(P_ROC_BUS_DMD_SELECT, P_ROC_DMD_DOT_TABLE_BASE_ADDR + offset, numWords);
+            if (WriteBurst(header, p_dmd_frame_buffer_words + offset, numWords, true) != kPRSuccess)
+            {
+                // Part of the frame may have landed; send the next one in full.
+                if (!dmdShadowValid.empty())
+                    dmdShadowValid[dmdWriteBuffer] = false;
+                return kPRFailure;
+            }
+        }
+        stats.dmdBytesSent += fullBytes;
+    }
+    else
+    {
+        // The hardware buffer this frame lands in still holds what was last
+        // sent to it.  That relies on the FPGA moving its write pointer on by
+        // exactly one buffer, modulo numFrameBuffers, each time the last word
+        // of a frame is written, which is why diffing is opt-in: if the
+        // hardware ever skips or repeats a buffer, dmdWriteBuffer no longer
+        // names the buffer being written and nothing here would notice.
+        // Send only the runs of words that differ, plus the last
+        // word, whose write marks the frame ready and advances the write
+        // pointer.  Runs closer than two words apart are merged, since each
+        // burst costs a header word.
+        uint32_t * shadow = &dmdShadow[dmdWriteBuffer * words_per_frame];
+        uint64_t sentBytes = 0;
+        int32_t i = 0;
+        while (i < words_per_frame)
+        {
+            if (i < words_per_frame - 1 && p_dmd_frame_buffer_words[i] == shadow[i])
+            {
+                i++;
+                continue;
+            }
+            int32_t start = i, end = i + 1;
+            for (int32_t j = end; j < words_per_frame && j - start < maxDMDBurstWords; j++)
+            {
+                if (j == words_per_frame - 1 || p_dmd_frame_buffer_words[j] != shadow[j])
+                    end = j + 1;
+                else if (j - end >= 1)
+                    break;
+            }
+            uint32_t * burst = ReservePreparedWords(end - start + 1);
+            if (burst == NULL)
+            {
+                // Earlier runs may already have been flushed to the buffer.
+                dmdShadowValid[dmdWriteBuffer] = false;
+                return kPRFailure;
+            }
+            burst[0] = CreateBurstCommand(P_ROC_BUS_DMD_SELECT, P_ROC_DMD_DOT_TABLE_BASE_ADDR + start, end - start);
+            memcpy(burst + 1, p_dmd_frame_buffer_words + start, (end - start) * 4);
+            sentBytes += (end - start + 1) * 4;
+            i = end;
+        }
+        if (FlushWriteData() != kPRSuccess)
+        {
+            dmdShadowValid[dmdWriteBuffer] = false;
+            return kPRFailure;
+        }
+        stats.dmdBytesSent += sentBytes;
+        if (sentBytes < fullBytes)
+            stats.dmdBytesSaved += fullBytes - sentBytes;
+    }
 
-    dmd_command_buffer[0] = CreateBurstCommand(P_ROC_BUS_DMD_SELECT, P_ROC_DMD_DOT_TABLE_BASE_ADDR, words_per_frame);
-    for (k=0; k<words_per_frame; k++) {
-        dmd_command_buffer[k+1] = p_dmd_frame_buffer_words[k];
+    if (dmdDiffEnabled && !dmdShadowValid.empty())
+    {
+        memcpy(&dmdShadow[dmdWriteBuffer * words_per_frame], p_dmd_frame_buffer_words, words_per_frame * 4);
+        dmdShadowValid[dmdWriteBuffer] = true;
+        if (dmdConfig.autoIncBufferWrPtr)
+            dmdWriteBuffer = (dmdWriteBuffer + 1) % dmdShadowValid.size();
     }
+    return kPRSuccess;
+}
 
-    return PrepareWriteData(dmd_command_buffer, words_per_frame+1);
+PRResult PRDevice::DMDSetFrameDiffing(bool enable)
+{
+    // Start from full frames either way.  Once every buffer has had one, the
+    // shadows follow the write pointer however far it was from buffer 0.
+    dmdDiffEnabled = enable;
+    dmdShadowValid.assign(dmdShadowValid.size(), false);
+    return kPRSuccess;
 }
 
-PRResult PRDevice::PRJTAGDriveOutputs(PRJTAGOutputs * jtagOutputs, bool_t toggleClk)
+PRResult PRDevice::DMDSetColorMap(const uint8_t * colorMap, int32_t numEntries)
 {
-    const int burstSize = 2;
-    uint32_t burst[burstSize];
+    if (colorMap == NULL)
+    {
+        dmdColorMapSet = false;
+        SetDefaultDMDColorMap();
+        return kPRSuccess;
+    }
+    if (numEntries != 16 && numEntries != 256)
+    {
+        PRSetLastErrorText("A DMD color map has 16 or 256 entries, not %d.", numEntries);
+        return kPRFailure;
+    }
+    // 16 entries are for 4-bit pixels; the upper bits are ignored.
+    for (int i = 0; i < 256; i++)
+        dmdColorMap[i] = colorMap[i & (numEntries - 1)];
+    dmdColorMapSet = true;
+    return kPRSuccess;
+}
 
-    if (toggleClk) CreateJTAGLatchOutputsBurst( burst, jtagOutputs );
-    else CreateJTAGForceOutputsBurst( burst, jtagOutputs );
-    return WriteData(burst, burstSize);
+void PRDevice::SetDefaultDMDColorMap()
+{
+    // Grayscale pixels keep their top numSubFrames bits, subframe 0 being
+    // the least significant.
+    int shift = dmdConfig.numSubFrames < 8 ? 8 - dmdConfig.numSubFrames : 0;
+    for (int i = 0; i < 256; i++)
+        dmdColorMap[i] = (uint8_t)(i >> shift);
 }
 
-PRResult PRDevice::PRJTAGWriteTDOMemory(uint16_t tableOffset, uint16_t numWords, uint32_t * tdoData)
+PRResult PRDevice::DMDDrawPixels(const uint8_t * pixels, uint32_t stride, bool useColorMap)
 {
-    int32_t i;
-    const int maxBurstSize = 513;
-    uint32_t burst[maxBurstSize];
+    if (dmdPixelFrame.empty())
+    {
+        PRSetLastErrorText("The DMD must be configured before drawing pixels.");
+        return kPRFailure;
+    }
+    if (PRDMDEncodePlanes(&dmdPixelFrame[0], pixels, stride, dmdConfig.numColumns, dmdConfig.numRows,
+                          dmdConfig.numSubFrames, useColorMap ? dmdColorMap : NULL) != kPRSuccess)
+        return kPRFailure;
+    return DMDDraw(&dmdPixelFrame[0]);
+}
 
-    burst[0] = CreateBurstCommand(P_ROC_BUS_JTAG_SELECT, P_ROC_JTAG_TDO_MEMORY_BASE_ADDR + tableOffset, numWords);
-    for (i=0; i<numWords; i++) {
-        burst[i+1] = tdoData[i];
+PRResult PRDevice::DMDQueueFrame(const uint8_t * dots, uint64_t displayTimeNs)
+{
+    int32_t frameBytes = (dmdConfig.numColumns * dmdConfig.numRows) / 8 * dmdConfig.numSubFrames;
+
+    if (dmdShadowValid.empty() || frameBytes == 0)
+    {
+        PRSetLastErrorText("The DMD must be configured before queueing frames.");
+        return kPRFailure;
+    }
+    if (!dmdConfig.enableFrameEvents)
+    {
+        PRSetLastErrorText("The DMD frame queue needs enableFrameEvents in the DMD config.");
+        return kPRFailure;
+    }
+    if (dmdQueueCount == maxQueuedDMDFrames)
+    {
+        PRSetLastErrorText("The DMD frame queue is full (%d frames).", maxQueuedDMDFrames);
+        return kPRFailure;
     }
 
-    return WriteData(burst, numWords + 1);
+    if (dmdQueueFrames.empty())
+        dmdQueueFrames.resize(maxQueuedDMDFrames * frameBytes);
+    uint32_t slot = (dmdQueueHead + dmdQueueCount) % maxQueuedDMDFrames;
+    memcpy(&dmdQueueFrames[slot * frameBytes], dots, frameBytes);
+    dmdQueueTimes[slot] = displayTimeNs;
+    dmdQueueMissed[slot] = false;
+    dmdQueueCount++;
+    dmdQueueStatus.framesQueued++;
+
+    // Goes straight out if a buffer is free, which is how the queue fills
+    // the buffers to begin with.
+    return ServiceDMDQueue(false);
 }
 
-PRResult PRDevice::PRJTAGShiftTDOData(uint16_t numBits, bool_t dataBlockComplete)
+PRResult PRDevice::DMDQueueClear()
 {
-    const int burstSize = 2;
-    uint32_t burst[burstSize];
-
-    CreateJTAGShiftTDODataBurst( burst, numBits, dataBlockComplete );
-    return WriteData(burst, burstSize);
+    dmdQueueHead = 0;
+    dmdQueueCount = 0;
+    return kPRSuccess;
 }
 
-PRResult PRDevice::PRJTAGReadTDIMemory(uint16_t tableOffset, uint16_t numWords, uint32_t * tdiData)
+PRResult PRDevice::DMDQueueGetStatus(PRDMDQueueStatus * status)
 {
-    return ReadDataRaw (P_ROC_BUS_JTAG_SELECT, P_ROC_JTAG_TDI_MEMORY_BASE_ADDR + tableOffset, numWords, tdiData);
+    *status = dmdQueueStatus;
+    status->depth = dmdQueueCount;
+    status->capacity = maxQueuedDMDFrames;
+    status->buffersFilled = DMDQueueMaxCredits() - dmdQueueCredits;
+    return kPRSuccess;
 }
 
-PRResult PRDevice::PRJTAGGetStatus(PRJTAGStatus * status)
+uint32_t PRDevice::DMDQueueMaxCredits()
 {
-    uint32_t rdBuffer[1];
-	PRResult res = ReadDataRaw(P_ROC_BUS_JTAG_SELECT, P_ROC_JTAG_STATUS_REG_BASE_ADDR, 1, rdBuffer);
-	if (res == kPRFailure)
-		return res;
-    status->commandComplete = rdBuffer[0] >> P_ROC_JTAG_STATUS_DONE_SHIFT;
-    status->tdi = rdBuffer[0] >> P_ROC_JTAG_STATUS_TDI_SHIFT;
-	return res;
+    // With autoIncBufferWrPtr the write pointer cycles through the buffers,
+    // and all but the one on display can take a frame.  Without it every
+    // frame lands in the same buffer, so one per frame event is the most
+    // that can be shown.
+    if (!dmdConfig.autoIncBufferWrPtr || dmdConfig.numFrameBuffers < 2)
+        return 1;
+    return dmdConfig.numFrameBuffers - 1;
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////
-// Device I/O
+void PRDevice::DMDQueueReset()
+{
+    DMDQueueClear();
+    dmdQueueCredits = DMDQueueMaxCredits();
+}
 
-PRResult PRDevice::Open()
+template <typename Event>
+void PRDevice::DMDQueueNoteEvents(const Event *events, int numEvents)
 {
-    uint32_t temp_word;
-    PRResult res = PRHardwareOpen();
-    if (res == kPRSuccess)
+    // This runs on every batch of events; without frame events there is
+    // nothing to look for.
+    if (!dmdConfig.enableFrameEvents)
+        return;
+    for (int i = 0; i < numEvents; i++)
     {
-        // Try to verify the P-ROC IS in the FPGA before initializing the FPGA's FTDI interface
-        // just in case it was already initialized from a previous application execution.
-        DEBUG(PRLog(kPRLogInfo, "Verifying P-ROC ID: \n"));
+        if (events[i].type != kPREventTypeDMDFrameDisplayed)
+            continue;
+        // A frame left its buffer for the display.  If every buffer had
+        // already been displayed, the panel is showing an old frame again.
+        if (dmdQueueCredits < DMDQueueMaxCredits())
+            dmdQueueCredits++;
+        else if (dmdQueueStatus.framesQueued > 0 && dmdAnimation == NULL)
+            dmdQueueStatus.underruns++;
+        // With nothing queued and no animation, counting the credit is all
+        // there is to do.
+        PRResult result = kPRSuccess;
+        if (dmdAnimation != NULL)
+            result = ServiceDMDAnimation();
+        else if (dmdQueueCount > 0)
+            result = ServiceDMDQueue(true);
+        if (result != kPRSuccess)
+            DEBUG(PRLog(kPRLogError, "DMD frame queue: %s\n", PRGetLastErrorText()));
+    }
+}
 
-        // Attempt to turn off events.  This is necessary if P-ROC wasn't shut down
-        // properly previously.  If the P-ROC isn't initialized, this request will
-        // be ignored.
+PRResult PRDevice::ServiceDMDQueue(bool frameEvent)
+{
+    // Leave before reading the clock when there is nothing to send.
+    if (dmdAnimation != NULL || dmdQueueCount == 0)
+        return kPRSuccess;
 
-        PRDMDConfig dmdConfig;
-        dmdConfig.numRows = 32; // Doesn't matter.
-        dmdConfig.numColumns = 128; // Doesn't matter
-        dmdConfig.numSubFrames = 4; // Doesn't matter
-        dmdConfig.numFrameBuffers = 3; // Doesn't matter
-        dmdConfig.autoIncBufferWrPtr = false;
-        dmdConfig.enableFrameEvents = false;
-        DMDUpdateConfig(&dmdConfig);
+    int32_t frameBytes = (dmdConfig.numColumns * dmdConfig.numRows) / 8 * dmdConfig.numSubFrames;
+    uint64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 
-        PRSwitchConfig switchConfig;
-        switchConfig.clear = false;
-        switchConfig.use_column_9 = false;
-        switchConfig.use_column_8 = false;
-        switchConfig.hostEventsEnable = false;
-        switchConfig.directMatrixScanLoopTime = 2; // milliseconds
-        switchConfig.pulsesBeforeCheckingRX = 10;
-        switchConfig.inactivePulsesAfterBurst = 12;
-        switchConfig.pulsesPerBurst = 6;
-        switchConfig.pulseHalfPeriodTime = 13; // milliseconds
-        SwitchUpdateConfig(&switchConfig);
+    while (dmdQueueCount > 0 && dmdQueueCredits > 0 && dmdQueueTimes[dmdQueueHead] <= nowNs)
+    {
+        // A timed frame whose successor is already due would only be on the
+        // panel for a frame before being replaced; skip it.  Untimed frames
+        // are all shown, one per buffer.
+        uint32_t next = (dmdQueueHead + 1) % maxQueuedDMDFrames;
+        bool superseded = dmdQueueCount > 1 && dmdQueueTimes[dmdQueueHead] != 0 &&
+                          dmdQueueTimes[next] != 0 && dmdQueueTimes[next] <= nowNs;
+        if (superseded)
+        {
+            dmdQueueStatus.framesDropped++;
+        }
+        else
+        {
+            if (DMDDraw(&dmdQueueFrames[dmdQueueHead * frameBytes]) != kPRSuccess)
+                return kPRFailure;
+            dmdQueueCredits--;
+            dmdQueueStatus.framesUploaded++;
+            if (dmdQueueMissed[dmdQueueHead])
+                dmdQueueStatus.framesLate++;
+        }
+        dmdQueueHead = next;
+        dmdQueueCount--;
+    }
 
-        // Flush read data to ensure VerifyChipID starts with clean buffer.
-        // It's possible the P-ROC has a lot of data stored up in internal buffers.  So if
-        // the verify still fails, do a bunch of flushes.
-        res = FlushReadBuffer();
-        uint32_t verify_ctr = 0;
-        res = VerifyChipID();
+    // Timed frames still waiting after a frame event have missed it.
+    if (frameEvent)
+    {
+        for (uint32_t i = 0; i < dmdQueueCount; i++)
+        {
+            uint32_t slot = (dmdQueueHead + i) % maxQueuedDMDFrames;
+            if (dmdQueueTimes[slot] != 0 && dmdQueueTimes[slot] <= nowNs)
+                dmdQueueMissed[slot] = true;
+        }
+    }
+    return kPRSuccess;
+}
+
+PRResult PRDevice::DMDPlayAnimation(PRDMDAnimation * animation, bool loop)
+{
+    PRDMDAnimationInfo info;
+    animation->GetInfo(&info);
+    if (dmdShadowValid.empty() || info.numColumns != dmdConfig.numColumns ||
+        info.numRows != dmdConfig.numRows || info.numSubFrames != dmdConfig.numSubFrames)
+    {
+        PRSetLastErrorText("DMD animation is %dx%d with %d subframes; the DMD is configured for %dx%d with %d.",
+                           info.numColumns, info.numRows, info.numSubFrames,
+                           dmdConfig.numColumns, dmdConfig.numRows, dmdConfig.numSubFrames);
+        return kPRFailure;
+    }
+    if (!dmdConfig.enableFrameEvents)
+    {
+        PRSetLastErrorText("DMD animations need enableFrameEvents in the DMD config.");
+        return kPRFailure;
+    }
+
+    SetDMDAnimation(animation);
+    dmdAnimationLoop = loop;
+    dmdAnimationNext = 0;
+    dmdAnimationHold = 0;
+    // The first frame goes now if a buffer is free, rather than waiting
+    // for the next frame event.
+    if (dmdQueueCredits > 0)
+        return ServiceDMDAnimation();
+    return kPRSuccess;
+}
+
+PRResult PRDevice::DMDStopAnimation()
+{
+    SetDMDAnimation(NULL);
+    return kPRSuccess;
+}
+
+void PRDevice::SetDMDAnimation(PRDMDAnimation *animation)
+{
+    // Retain first, so replaying the animation already playing can't free it.
+    if (animation != NULL)
+        animation->Retain();
+    if (dmdAnimation != NULL)
+        dmdAnimation->Release();
+    dmdAnimation = animation;
+}
+
+int32_t PRDevice::DMDAnimationCurrentFrame()
+{
+    if (dmdAnimation == NULL)
+        return -1;
+    return dmdAnimationNext > 0 ? dmdAnimationNext - 1 : 0;
+}
+
+PRResult PRDevice::ServiceDMDAnimation()
+{
+    // Sending nothing at a frame event leaves the last frame sent on the
+    // display for another frame, which is how repeats are played.
+    if (dmdAnimationHold > 0)
+    {
+        dmdAnimationHold--;
+        return kPRSuccess;
+    }
+    if (dmdAnimationNext == dmdAnimation->NumFrames())
+    {
+        if (!dmdAnimationLoop)
+        {
+            SetDMDAnimation(NULL);
+            return ServiceDMDQueue(true);
+        }
+        dmdAnimationNext = 0;
+    }
+    if (dmdQueueCredits == 0)
+        return kPRSuccess;
+
+    // DMDDraw() only reads the frame, straight from the mapping.
+    if (DMDDraw((uint8_t *)dmdAnimation->Frame(dmdAnimationNext)) != kPRSuccess)
+        return kPRFailure;
+    dmdQueueCredits--;
+    dmdAnimationHold = dmdAnimation->Repeat(dmdAnimationNext) - 1;
+    dmdAnimationNext++;
+    return kPRSuccess;
+}
+
+PRResult PRDevice::DMDComposite()
+{
+    if (dmdComposite.empty())
+    {
+        PRSetLastErrorText("The DMD must be configured before compositing.");
+        return kPRFailure;
+    }
+    if (!dmdCompositor.Composite(&dmdComposite[0], dmdConfig.numColumns, dmdConfig.numRows))
+        return kPRSuccess;
+    if (DMDDrawPixels(&dmdComposite[0], dmdConfig.numColumns, true) != kPRSuccess)
+    {
+        // Composite() has already cleared the dirty rows; redraw them all next time.
+        dmdCompositor.Invalidate();
+        return kPRFailure;
+    }
+    return kPRSuccess;
+}
+
+PRResult PRDevice::PRJTAGDriveOutputs(PRJTAGOutputs * jtagOutputs, bool_t toggleClk)
+{
+    const int burstSize = 2;
+    uint32_t burst[burstSize];
+
+    if (toggleClk) CreateJTAGLatchOutputsBurst( burst, jtagOutputs );
+    else CreateJTAGForceOutputsBurst( burst, jtagOutputs );
+    return WriteData(burst, burstSize);
+}
+
+PRResult PRDevice::PRJTAGWriteTDOMemory(uint16_t tableOffset, uint16_t numWords, uint32_t * tdoData)
+{
+    int32_t i;
+    const int maxBurstSize = 513;
+    uint32_t burst[maxBurstSize];
+
+    burst[0] = CreateBurstCommand(P_ROC_BUS_JTAG_SELECT, P_ROC_JTAG_TDO_MEMORY_BASE_ADDR + tableOffset, numWords);
+    for (i=0; i<numWords; i++) {
+        burst[i+1] = tdoData[i];
+    }
+
+    return WriteData(burst, numWords + 1);
+}
+
+PRResult PRDevice::PRJTAGShiftTDOData(uint16_t numBits, bool_t dataBlockComplete)
+{
+    const int burstSize = 2;
+    uint32_t burst[burstSize];
+
+    CreateJTAGShiftTDODataBurst( burst, numBits, dataBlockComplete );
+    return WriteData(burst, burstSize);
+}
+
+PRResult PRDevice::PRJTAGReadTDIMemory(uint16_t tableOffset, uint16_t numWords, uint32_t * tdiData)
+{
+    return ReadDataRaw (P_ROC_BUS_JTAG_SELECT, P_ROC_JTAG_TDI_MEMORY_BASE_ADDR + tableOffset, numWords, tdiData);
+}
+
+PRResult PRDevice::PRJTAGGetStatus(PRJTAGStatus * status)
+{
+    uint32_t rdBuffer[1];
+	PRResult res = ReadDataRaw(P_ROC_BUS_JTAG_SELECT, P_ROC_JTAG_STATUS_REG_BASE_ADDR, 1, rdBuffer);
+	if (res == kPRFailure)
+		return res;
+    status->commandComplete = rdBuffer[0] >> P_ROC_JTAG_STATUS_DONE_SHIFT;
+    status->tdi = rdBuffer[0] >> P_ROC_JTAG_STATUS_TDI_SHIFT;
+	return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Device I/O
+
+PRResult PRDevice::Open()
+{
+    uint32_t temp_word;
+    DEBUG(PRLog(kPRLogInfo, "Byte order conversion: %s\n", PRByteOrderKernelName()));
+    DEBUG(PRLog(kPRLogInfo, "DMD encoder: %s\n", PRDMDEncoderKernelName()));
+    DEBUG(PRLog(kPRLogInfo, "DMD compositor: %s\n", PRDMDCompositorKernelName()));
+    PRResult res = transport->Open();
+    if (res == kPRSuccess)
+    {
+        // Try to verify the P-ROC IS in the FPGA before initializing the FPGA's FTDI interface
+        // just in case it was already initialized from a previous application execution.
+        DEBUG(PRLog(kPRLogInfo, "Verifying P-ROC ID: \n"));
+
+        // Attempt to turn off events.  This is necessary if P-ROC wasn't shut down
+        // properly previously.  If the P-ROC isn't initialized, this request will
+        // be ignored.
+
+        PRDMDConfig dmdConfig;
+        dmdConfig.numRows = 32; // Doesn't matter.
+        dmdConfig.numColumns = 128; // Doesn't matter
+        dmdConfig.numSubFrames = 4; // Doesn't matter
+        dmdConfig.numFrameBuffers = 3; // Doesn't matter
+        dmdConfig.autoIncBufferWrPtr = false;
+        dmdConfig.enableFrameEvents = false;
+        DMDUpdateConfig(&dmdConfig);
+
+        PRSwitchConfig switchConfig;
+        switchConfig.clear = false;
+        switchConfig.use_column_9 = false;
+        switchConfig.use_column_8 = false;
+        switchConfig.hostEventsEnable = false;
+        switchConfig.directMatrixScanLoopTime = 2; // milliseconds
+        switchConfig.pulsesBeforeCheckingRX = 10;
+        switchConfig.inactivePulsesAfterBurst = 12;
+        switchConfig.pulsesPerBurst = 6;
+        switchConfig.pulseHalfPeriodTime = 13; // milliseconds
+        SwitchUpdateConfig(&switchConfig);
+
+        // Flush read data to ensure VerifyChipID starts with clean buffer.
+        // It's possible the P-ROC has a lot of data stored up in internal buffers.  So if
+        // the verify still fails, do a bunch of flushes.
+        res = FlushReadBuffer();
+        uint32_t verify_ctr = 0;
+        res = VerifyChipID();
         while (res == kPRFailure && verify_ctr++ < 5) {
             // Only send init pattern once.
             if (verify_ctr == 1) {
@@ -1016,8 +1536,7 @@ PRResult PRDevice::Open()
 
 PRResult PRDevice::Close()
 {
-    // TODO: Add protection against closing a not-open ftdic.
-    PRHardwareClose();
+    transport->Close();
     return kPRSuccess;
 }
 
@@ -1032,27 +1551,17 @@ PRResult PRDevice::VerifyChipID()
     const int bufferWords = 5;
     uint32_t buffer[bufferWords] = {0};
     //uint32_t temp_word;
-    uint32_t max_count, i;
-    const uint32_t max_count_limit = 10;
+    uint32_t i;
 
     //std::cout << "Requesting FPGA Chip ID: ";
     rc = RequestData(P_ROC_MANAGER_SELECT, P_ROC_REG_CHIP_ID_ADDR, 4);
 
-    max_count = 0;
-    // Wait for data to return.  Give it 10 loops before giving up.
-    while (requestedDataQueue.size() < 5 && max_count++ < max_count_limit)
-    {
-        PRSleep (10); // 10 milliseconds should be plenty of time.
-		if (SortReturningData() != kPRSuccess)
-			return kPRFailure;
-    }
-
-    if (max_count != max_count_limit+1) {
+    // Wait for data to return.
+    if (WaitForRequestedData(bufferWords, requestedDataTimeoutUs) == kPRSuccess) {
 
-        if (requestedDataQueue.size() == 5) {
+        if (requestedDataQueue.Size() == 5) {
             for (i = 0; i < bufferWords; i++) {
-                buffer[i] = requestedDataQueue.front();
-                requestedDataQueue.pop(); // Ignore address word.  TODO: Verify the address.
+                requestedDataQueue.Pop(buffer[i]); // buffer[0] is the address word, already matched to this read by RouteRequestedFrame().
             }
             if (buffer[1] != P_ROC_CHIP_ID && buffer[1] != P3_ROC_CHIP_ID)
             {
@@ -1068,6 +1577,7 @@ PRResult PRDevice::VerifyChipID()
             chip_id = buffer[1];
             revision = buffer[2] & 0xffff;
             version = buffer[2] >> 16;
+            SetEventFormat(version);
             CalcCombinedVerRevision();
             DEBUG(PRLog(kPRLogError, "FPGA Chip Version/Rev: %d.%d\n", version, revision));
             DEBUG(PRLog(kPRLogInfo, "Watchdog Settings: 0x%x\n", buffer[3]));
@@ -1077,8 +1587,8 @@ PRResult PRDevice::VerifyChipID()
             else readMachineType = kPRMachineWPC; // Choose WPC or WPC95, doesn't matter.
         }
         else {
-            DEBUG(PRLog(kPRLogError, "Error reading Chip IP and Version. Read %d words instead of 5. The first 2 were: 0x%x and 0x%x.\n", requestedDataQueue.size(), buffer[0], buffer[1]));
-            PRSetLastErrorText("Error reading Chip IP and Version. Read %d words instead of 5. The first 2 were: 0x%x and 0x%x.", requestedDataQueue.size(), buffer[0], buffer[1]);
+            DEBUG(PRLog(kPRLogError, "Error reading Chip IP and Version. Read %d words instead of 5. The first 2 were: 0x%x and 0x%x.\n", requestedDataQueue.Size(), buffer[0], buffer[1]));
+            PRSetLastErrorText("Error reading Chip IP and Version. Read %d words instead of 5. The first 2 were: 0x%x and 0x%x.", requestedDataQueue.Size(), buffer[0], buffer[1]);
             rc = kPRFailure;
         }
     }
@@ -1094,16 +1604,206 @@ PRResult PRDevice::VerifyChipID()
 
 PRResult PRDevice::RequestData(uint32_t module_select, uint32_t start_addr, int32_t num_words)
 {
-    uint32_t requestWord = CreateRegRequestWord(module_select, start_addr, num_words);
-    return WriteData(&requestWord, 1);
+    PRReadRequest request = { module_select, start_addr, num_words, NULL };
+    return RequestData(&request, 1);
+}
+
+PRResult PRDevice::RequestData(const PRReadRequest *requests, int32_t numRequests)
+{
+    uint32_t requestWords[maxReadsPerRequest];
+    int32_t i;
+
+    if (numRequests > maxReadsPerRequest)
+    {
+        PRSetLastErrorText("%d read requests exceeds the limit of %d.", numRequests, maxReadsPerRequest);
+        return kPRFailure;
+    }
+    for (i = 0; i < numRequests; i++)
+    {
+        requestWords[i] = CreateRegRequestWord(requests[i].moduleSelect, requests[i].startingAddr, requests[i].numWords);
+        if (AddPendingRead(requestWords[i], requests[i].moduleSelect, requests[i].startingAddr, NULL, NULL) != kPRSuccess)
+        {
+            numPendingReads -= i; // Never sent.
+            return kPRFailure;
+        }
+    }
+    // Queue the requests behind the buffered writes and send the lot in one
+    // transfer.  Reads see every write made before them, and replies come
+    // back in the order the reads were registered.
+    if (PrepareWriteData(requestWords, numRequests) != kPRSuccess)
+    {
+        numPendingReads -= numRequests;
+        return kPRFailure;
+    }
+    return FlushWriteData();
+}
+
+template <typename Done> int PRDevice::WaitForReplies(uint32_t timeoutUs, Done done)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = start + std::chrono::microseconds(timeoutUs);
+    std::chrono::steady_clock::time_point spinUntil = start + std::chrono::microseconds(requestedDataSpinUs);
+    std::chrono::microseconds poll(requestedDataPollMinUs);
+
+    // A reply usually takes well under 2 ms.  Poll flat out for the first
+    // requestedDataSpinUs, then back off.  With an I/O thread, block until
+    // it reports requested data instead of sleeping blind.
+    while (true)
+    {
+        if (SortReturningData() != kPRSuccess)
+            return -1;
+        if (done())
+            return 1;
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+            return 0;
+        if (now < spinUntil)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::chrono::steady_clock::time_point wakeAt = std::min(deadline, now + poll);
+        if (ioThreadRunning)
+        {
+            // The I/O thread pushes whole replies, so anything in the ring
+            // is ready to be routed.
+            std::unique_lock<std::mutex> lock(requestedMutex);
+            requestedCond.wait_until(lock, wakeAt, [this] { return requestedRing->Size() > 0; });
+        }
+        else
+            std::this_thread::sleep_until(wakeAt);
+        poll = std::min(poll * 2, std::chrono::microseconds(requestedDataPollMaxUs));
+    }
+}
+
+PRResult PRDevice::WaitForRequestedData(uint32_t numWords, uint32_t timeoutUs)
+{
+    int rc = WaitForReplies(timeoutUs, [this, numWords] { return requestedDataQueue.Size() >= numWords; });
+    if (rc > 0)
+        return kPRSuccess;
+
+    if (rc == 0)
+        PRSetLastErrorText("Timed out waiting for %d words of requested data (%d arrived).", numWords, requestedDataQueue.Size());
+    // Whatever trickles in later belongs to a read nobody is waiting for.
+    AbandonPendingReads(false);
+    requestedDataQueue.Clear();
+    return kPRFailure;
+}
+
+PRResult PRDevice::AddPendingRead(uint32_t requestWord, uint32_t moduleSelect, uint32_t startingAddr, PRReadCallback callback, void *userData)
+{
+    // Abandoned reads at the front are only kept to recognize late replies;
+    // make room by forgetting them.
+    while (numPendingReads == maxPendingReads && pendingReads[pendingReadsHead].abandoned)
+    {
+        pendingReadsHead = (pendingReadsHead + 1) % maxPendingReads;
+        numPendingReads--;
+    }
+    if (numPendingReads == maxPendingReads)
+    {
+        PRSetLastErrorText("Too many reads outstanding (%d).", maxPendingReads);
+        return kPRFailure;
+    }
+
+    PRPendingRead *read = &pendingReads[(pendingReadsHead + numPendingReads) % maxPendingReads];
+    read->key = requestWord & ~P_ROC_COMMAND_MASK;
+    read->moduleSelect = moduleSelect;
+    read->startingAddr = startingAddr;
+    read->callback = callback;
+    read->userData = userData;
+    read->abandoned = false;
+    numPendingReads++;
+    return kPRSuccess;
+}
+
+int PRDevice::AbandonPendingReads(bool includeAsync)
+{
+    int numAbandoned = 0;
+    for (uint32_t i = 0; i < numPendingReads; i++)
+    {
+        PRPendingRead *read = &pendingReads[(pendingReadsHead + i) % maxPendingReads];
+        if (read->abandoned || (read->callback != NULL && !includeAsync))
+            continue;
+        read->abandoned = true;
+        numAbandoned++;
+        if (read->callback != NULL)
+            read->callback((PRHandle)this, kPRFailure, read->moduleSelect, read->startingAddr, NULL, 0, read->userData);
+    }
+    return numAbandoned;
+}
+
+int PRDevice::NumOutstandingAsyncReads()
+{
+    int numOutstanding = 0;
+    for (uint32_t i = 0; i < numPendingReads; i++)
+    {
+        PRPendingRead *read = &pendingReads[(pendingReadsHead + i) % maxPendingReads];
+        if (read->callback != NULL && !read->abandoned)
+            numOutstanding++;
+    }
+    return numOutstanding;
+}
+
+void PRDevice::RouteRequestedFrame(const uint32_t *frame, int32_t numWords)
+{
+    uint32_t key = frame[0] & ~P_ROC_COMMAND_MASK;
+    uint32_t index;
+
+    for (index = 0; index < numPendingReads; index++)
+        if (pendingReads[(pendingReadsHead + index) % maxPendingReads].key == key)
+            break;
+    if (index == numPendingReads)
+    {
+        DEBUG(PRLog(kPRLogWarning, "Dropping reply to a read that was never requested: 0x%x\n", frame[0]));
+        stats.readResponsesMismatched++;
+        return;
+    }
+
+    // Replies come back in request order, so any read ahead of this one has
+    // lost its reply.  Fail it now rather than let it wait out its timeout.
+    while (true)
+    {
+        PRPendingRead read = pendingReads[pendingReadsHead];
+        pendingReadsHead = (pendingReadsHead + 1) % maxPendingReads;
+        numPendingReads--;
+
+        if (index-- > 0)
+        {
+            DEBUG(PRLog(kPRLogWarning, "No reply to read of module %d address 0x%x\n", read.moduleSelect, read.startingAddr));
+            if (read.callback != NULL && !read.abandoned)
+                read.callback((PRHandle)this, kPRFailure, read.moduleSelect, read.startingAddr, NULL, 0, read.userData);
+            continue;
+        }
+
+        if (read.abandoned)
+            stats.readResponsesLate++;
+        else if (read.callback != NULL)
+            read.callback((PRHandle)this, kPRSuccess, read.moduleSelect, read.startingAddr, frame + 1, numWords - 1, read.userData);
+        else if (requestedDataQueue.Space() >= (uint32_t)numWords)
+            requestedDataQueue.Push(frame, numWords);
+        else
+            stats.requestedWordsDropped += numWords;
+        return;
+    }
 }
 
 PRResult PRDevice::PrepareWriteData(uint32_t * words, int32_t numWords)
+{
+    uint32_t *prepared = ReservePreparedWords(numWords);
+    if (prepared == NULL)
+        return kPRFailure;
+
+    memcpy(prepared, words, numWords * 4);
+    return kPRSuccess;
+}
+
+uint32_t *PRDevice::ReservePreparedWords(int32_t numWords)
 {
     if (numWords > maxWriteWords)
     {
         PRSetLastErrorText("%d words Exceeds write capabilities.  Restrict write requests to %d words.", numWords, maxWriteWords);
-        return kPRFailure;
+        return NULL;
     }
 
     // If there are already some words prepared to be written and the addition of the new
@@ -1111,13 +1811,12 @@ PRResult PRDevice::PrepareWriteData(uint32_t * words, int32_t numWords)
     if (numPreparedWriteWords + numWords > maxWriteWords)
     {
         if (FlushWriteData() == kPRFailure)
-            return kPRFailure;
+            return NULL;
     }
 
-    memcpy(preparedWriteWords + numPreparedWriteWords, words, numWords * 4);
+    uint32_t *prepared = preparedWriteWords + numPreparedWriteWords;
     numPreparedWriteWords += numWords;
-
-    return kPRSuccess;
+    return prepared;
 }
 
 PRResult PRDevice::FlushWriteData()
@@ -1125,33 +1824,74 @@ PRResult PRDevice::FlushWriteData()
     PRResult res;
     res = WriteData(preparedWriteWords, numPreparedWriteWords);
     numPreparedWriteWords = 0; // Reset word counter
+    if (res != kPRSuccess)
+        LEDShadowReset(); // The dropped words may have held PD-LED commands.
     return res;
 }
 
-PRResult PRDevice::WriteData(uint32_t * words, int32_t numWords)
+PRResult PRDevice::WriteData(const uint32_t * words, int32_t numWords)
 {
-    int32_t j,k;
-//  int32_t item;
+    if (!ioThreadRunning)
+        return TransportWrite(words, numWords);
 
+    // Hand the words to the I/O thread.  If the ring is full, wait for the
+    // thread to drain it rather than dropping commands.
+    while (numWords > 0)
+    {
+        uint32_t numPushed = writeRing->Push(words, numWords);
+        ioThreadWake.notify_one();
+        words += numPushed;
+        numWords -= numPushed;
+        if (numWords > 0)
+            std::this_thread::yield();
+    }
+    return kPRSuccess;
+}
+
+PRResult PRDevice::WriteBurst(uint32_t header, const uint32_t * payload, int32_t numPayloadWords, bool flushPrepared)
+{
+    const int32_t maxBurstWords = sizeof(wr_buffer) / 4;
+    int32_t numPrepared = flushPrepared ? numPreparedWriteWords : 0;
+    if (numPayloadWords + 1 > maxBurstWords - numPrepared)
+    {
+        PRSetLastErrorText("%d words Exceeds write capabilities.  Restrict write requests to %d words.", numPayloadWords + 1, maxBurstWords - numPrepared);
+        return kPRFailure;
+    }
+    if (!ioThreadRunning)
+    {
+        // Swap the prepared words, the header and the payload straight into
+        // wr_buffer and send them in one transfer.
+        PRWordsToWire(wr_buffer, preparedWriteWords, numPrepared);
+        PRWordsToWire(wr_buffer + numPrepared * 4, &header, 1);
+        PRWordsToWire(wr_buffer + (numPrepared + 1) * 4, payload, numPayloadWords);
+        if (flushPrepared)
+            numPreparedWriteWords = 0;
+        PRResult res = TransportWriteBuffer((numPrepared + numPayloadWords + 1) * 4);
+        if (res != kPRSuccess && numPrepared > 0)
+            LEDShadowReset();
+        return res;
+    }
+    if (flushPrepared && FlushWriteData() != kPRSuccess)
+        return kPRFailure;
+    if (WriteData(&header, 1) != kPRSuccess)
+        return kPRFailure;
+    return WriteData(payload, numPayloadWords);
+}
+
+PRResult PRDevice::TransportWrite(const uint32_t * words, int32_t numWords)
+{
     if (numWords == 0)
         return kPRSuccess;
 
-    // The 32-bit words coming in are in the same byte order they need to be in the P-ROC.
-    // However, due to Intel endian-ness, simply casting the words to 4 bytes changes the
-    // byte order.  So, the conversion to bytes is done here manually to preserve the byte
-    // order.  Might want to add a parameter for endian-ness at some point to make it
-    // work on big endian architectures.
-    for (j = 0; j < numWords; j++) {
-        uint32_t temp_word = words[j];
-        for (k = 3; k >= 0; k--)
-        {
-            wr_buffer[(j*4)+k] = (uint8_t)(temp_word & 0x000000ff);
-            temp_word = temp_word >> 8;
-        }
-    }
+    // The 32-bit words coming in are in the same byte order they need to be in the P-ROC,
+    // but the wire is big endian, so each word is byte-swapped on the way out.
+    PRWordsToWire(wr_buffer, words, numWords);
+    return TransportWriteBuffer(numWords * 4);
+}
 
-    int bytesToWrite = numWords * 4;
-    int bytesWritten = PRHardwareWrite(wr_buffer, bytesToWrite);
+PRResult PRDevice::TransportWriteBuffer(int bytesToWrite)
+{
+    int bytesWritten = transport->Write(wr_buffer, bytesToWrite);
 
     if (bytesWritten != bytesToWrite)
     {
@@ -1166,101 +1906,118 @@ PRResult PRDevice::WriteData(uint32_t * words, int32_t numWords)
 
 PRResult PRDevice::WriteDataRawUnbuffered(uint32_t moduleSelect, uint32_t startingAddr, int32_t numWriteWords, uint32_t * writeBuffer)
 {
-	PRResult res;
-    uint32_t * buffer;
+    // Build the burst where it will be sent from.
+    uint32_t *burst = ReservePreparedWords(numWriteWords + 1);
+    if (burst == NULL)
+        return kPRFailure;
 
-    buffer = (uint32_t *)malloc((numWriteWords * 4) + 4);
-    buffer[0] = CreateBurstCommand(moduleSelect, startingAddr, numWriteWords);
-    memcpy(buffer+1, writeBuffer, numWriteWords * 4);
-    res = PrepareWriteData(buffer, numWriteWords + 1);
-    free (buffer);
-	return res;
+    burst[0] = CreateBurstCommand(moduleSelect, startingAddr, numWriteWords);
+    memcpy(burst + 1, writeBuffer, numWriteWords * 4);
+    return kPRSuccess;
 }
 
 PRResult PRDevice::WriteDataRaw(uint32_t moduleSelect, uint32_t startingAddr, int32_t numWriteWords, uint32_t * writeBuffer)
 {
-	PRResult res;
-    uint32_t * buffer;
+    return WriteBurst(CreateBurstCommand(moduleSelect, startingAddr, numWriteWords), writeBuffer, numWriteWords);
+}
 
-    buffer = (uint32_t *)malloc((numWriteWords * 4) + 4);
-    buffer[0] = CreateBurstCommand(moduleSelect, startingAddr, numWriteWords);
-    memcpy(buffer+1, writeBuffer, numWriteWords * 4);
-    res = WriteData(buffer, numWriteWords + 1);
-    free (buffer);
-	return res;
+PRResult PRDevice::ReadDataRaw(uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, uint32_t * readBuffer, uint32_t timeoutUs)
+{
+    PRReadRequest request = { moduleSelect, startingAddr, numReadWords, readBuffer };
+    return ReadDataMulti(&request, 1, timeoutUs);
 }
 
-PRResult PRDevice::ReadDataRaw(uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, uint32_t * readBuffer)
+PRResult PRDevice::ReadDataMulti(PRReadRequest *requests, int32_t numRequests, uint32_t timeoutUs)
 {
     int32_t i;
 
-    // Send out the request.
-    RequestData(moduleSelect, startingAddr, numReadWords);
-
-    i = 0; // Reset i so it can be used to prevent an infinite loop below
-
-    // Wait for data to return.  Give it 10 loops before giving up.
-    // Expect numReadWords + 1 word with the address.
-    while (requestedDataQueue.size() < (uint32_t)((numReadWords + 1)) && i++ < 10)
+    for (i = 0; i < numRequests; i++)
     {
-        PRSleep (10); // 10 milliseconds should be plenty of time.
-		if (SortReturningData() != kPRSuccess)
-			return kPRFailure;
+        if (requests[i].numWords < 1 || requests[i].numWords > maxReadWords)
+        {
+            PRSetLastErrorText("Cannot read %d words.  Reads must be 1 to %d words.", requests[i].numWords, maxReadWords);
+            return kPRFailure;
+        }
     }
 
-    // Make sure all of the requested words are available before processing them.
-    // Too many words is just as bad as not enough words.
-    // If too many come back, can they be trusted?
-    if (requestedDataQueue.size() == (uint32_t)(numReadWords + 1))
+    while (numRequests > 0)
     {
-        requestedDataQueue.pop(); // Ignore address word.  TODO: Verify the address.
-        for (i = 0; i < numReadWords; i++)
+        // Send as many requests at once as requestedDataQueue has room for
+        // the replies to.
+        uint32_t numWords = requests[0].numWords + 1;
+        int32_t numBatched = 1;
+        while (numBatched < numRequests && numBatched < maxReadsPerRequest &&
+               numWords + requests[numBatched].numWords + 1 <= requestedDataQueue.Capacity())
         {
-            readBuffer[i] =  requestedDataQueue.front();
-            requestedDataQueue.pop();
+            numWords += requests[numBatched].numWords + 1;
+            numBatched++;
         }
-        return kPRSuccess;
-    }
-    else
-    {
-        PRSetLastErrorText("Response length did not match.");
-        return kPRFailure;
-    }
-}
 
+        if (RequestData(requests, numBatched) != kPRSuccess)
+            return kPRFailure;
 
-int32_t PRDevice::ReadData(uint32_t *buffer, int32_t num_words)
-{
-    int32_t rc,i,j;
+        // Wait for data to return.
+        // Expect each block behind its address word.
+        if (WaitForRequestedData(numWords, timeoutUs) != kPRSuccess)
+            return kPRFailure;
 
-    // Just like in the write_data method, the bytes are ordered here manually to put
-    // them in the right order.  They are pulled from the collected_bytes_fifo 1 at a time
-    // and stuffed into 32-bit words, high byte to low byte.
-    if ((num_words * 4) <= num_collected_bytes) {
-        for (j=0; j<num_words; j++) {
-            // Initialize buffer position
-            buffer[j] = 0;
-            for (i=0; i<4; i++) {
-                buffer[j] = (collected_bytes_fifo[collected_bytes_rd_addr] << (24-(i*8))) |
-                buffer[j];
-                if (collected_bytes_rd_addr == (FTDI_BUFFER_SIZE-1))
-                    collected_bytes_rd_addr = 0;
-                else
-                    collected_bytes_rd_addr++;
-            }
+        // Make sure all of the requested words are available before processing them.
+        // Too many words is just as bad as not enough words.
+        // If too many come back, can they be trusted?
+        if (requestedDataQueue.Size() != numWords)
+        {
+            PRSetLastErrorText("Response length did not match.");
+            requestedDataQueue.Clear();
+            return kPRFailure;
+        }
+        for (i = 0; i < numBatched; i++)
+        {
+            uint32_t addressWord;
+            requestedDataQueue.Pop(addressWord); // Already matched to this read by RouteRequestedFrame().
+            requestedDataQueue.Pop(requests[i].dest, requests[i].numWords);
         }
-        num_collected_bytes -= (num_words * 4);
 
-        rc = num_words;
+        requests += numBatched;
+        numRequests -= numBatched;
     }
-    else {
-        PRSetLastErrorText("Read length did not match.");
-        rc = 0;
+    return kPRSuccess;
+}
+
+PRResult PRDevice::ReadDataAsync(uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, PRReadCallback callback, void *userData)
+{
+    if (numReadWords < 1 || numReadWords > maxReadWords)
+    {
+        PRSetLastErrorText("Cannot read %d words.  Reads must be 1 to %d words.", numReadWords, maxReadWords);
+        return kPRFailure;
     }
-    DEBUG(PRLog(kPRLogVerbose, "Read num bytes: %d\n", rc));
-    return (rc);
+    if (callback == NULL)
+    {
+        PRSetLastErrorText("PRReadDataAsync() requires a callback.");
+        return kPRFailure;
+    }
+
+    uint32_t requestWord = CreateRegRequestWord(moduleSelect, startingAddr, numReadWords);
+    if (AddPendingRead(requestWord, moduleSelect, startingAddr, callback, userData) != kPRSuccess)
+        return kPRFailure;
+    if (PrepareWriteData(&requestWord, 1) != kPRSuccess)
+    {
+        numPendingReads--; // Never sent.
+        return kPRFailure;
+    }
+    return kPRSuccess;
 }
 
+int PRDevice::WaitForReads(uint32_t timeoutUs)
+{
+    if (numPreparedWriteWords > 0 && FlushWriteData() != kPRSuccess)
+        return -1;
+    int rc = WaitForReplies(timeoutUs, [this] { return NumOutstandingAsyncReads() == 0; });
+    if (rc < 0)
+        return -1;
+    return rc > 0 ? 0 : AbandonPendingReads(true);
+}
+
+
 PRResult PRDevice::FlushReadBuffer()
 {
     int32_t numBytes,rc=0;
@@ -1275,34 +2032,89 @@ PRResult PRDevice::FlushReadBuffer()
     collected_bytes_rd_addr = 0;
     collected_bytes_wr_addr = 0;
     num_collected_bytes = 0;
+    // Replies to anything asked for so far were just thrown away.
+    AbandonPendingReads(true);
     return rc;
 }
 
+static_assert((FTDI_BUFFER_SIZE & (FTDI_BUFFER_SIZE - 1)) == 0, "collected_bytes_fifo must be a power-of-two size");
+
 int32_t PRDevice::CollectReadData()
 {
-    int32_t rc,i;
-    rc = PRHardwareRead(collect_buffer, FTDI_BUFFER_SIZE-num_collected_bytes);
-    if (rc < 0)
-        return rc;
-    for (i=0; i<rc; i++) {
-        collected_bytes_fifo[collected_bytes_wr_addr] = collect_buffer[i];
-        if (collected_bytes_wr_addr == (FTDI_BUFFER_SIZE-1))
-            collected_bytes_wr_addr = 0;
-        else
-            collected_bytes_wr_addr++;
+    int32_t rc, total = 0;
+
+    // Free space runs from the write pointer to the end of the fifo and then
+    // from the start up to the read pointer.  Only go back for the second
+    // segment if the first one filled up; otherwise the transport is drained.
+    while (num_collected_bytes < FTDI_BUFFER_SIZE) {
+        int32_t free_bytes = FTDI_BUFFER_SIZE - num_collected_bytes;
+        int32_t to_end = FTDI_BUFFER_SIZE - collected_bytes_wr_addr;
+        int32_t segment = free_bytes < to_end ? free_bytes : to_end;
+
+        rc = transport->Read(collected_bytes_fifo + collected_bytes_wr_addr, segment);
+        if (rc < 0)
+            return rc;
+        collected_bytes_wr_addr = (collected_bytes_wr_addr + rc) & (FTDI_BUFFER_SIZE - 1);
+        num_collected_bytes += rc;
+        total += rc;
+        if (rc < segment || collected_bytes_wr_addr != 0)
+            break;
     }
-    num_collected_bytes += rc;
-    if (rc > 0)
+    if (total > 0)
     {
-        DEBUG(PRLog(kPRLogVerbose, "Collected bytes: %d\n", rc));
+        DEBUG(PRLog(kPRLogVerbose, "Collected bytes: %d\n", total));
     }
-    return (rc);
+    return (total);
+}
+
+uint32_t PRDevice::PeekCollectedWord(int32_t index)
+{
+    return PRWireToWord(collected_bytes_fifo + ((collected_bytes_rd_addr + index * 4) & (FTDI_BUFFER_SIZE - 1)));
+}
+
+void PRDevice::ConsumeCollectedWords(int32_t numWords)
+{
+    collected_bytes_rd_addr = (collected_bytes_rd_addr + numWords * 4) & (FTDI_BUFFER_SIZE - 1);
+    num_collected_bytes -= numWords * 4;
 }
 
 PRResult PRDevice::SortReturningData()
+{
+    if (ioThreadRunning)
+    {
+        // The I/O thread owns the transport.  Pick up whatever requested
+        // data it has sorted out so far.
+        RouteRequestedRing();
+        return kPRSuccess;
+    }
+    return CollectAndSortReturningData();
+}
+
+void PRDevice::RouteRequestedRing()
+{
+    // Replies are reassembled in routedFrame; the ring's wrap can split one
+    // across two pops, or one pass may catch the I/O thread mid-push.
+    while (true)
+    {
+        uint32_t numWanted = 1;
+        if (numRoutedFrameWords > 0)
+            numWanted = ((routedFrame[0] & P_ROC_HEADER_LENGTH_MASK) >> P_ROC_HEADER_LENGTH_SHIFT) + 1 - numRoutedFrameWords;
+        uint32_t numPopped = requestedRing->Pop(routedFrame + numRoutedFrameWords, numWanted);
+        if (numPopped == 0)
+            return;
+        numRoutedFrameWords += numPopped;
+        int32_t frameWords = ((routedFrame[0] & P_ROC_HEADER_LENGTH_MASK) >> P_ROC_HEADER_LENGTH_SHIFT) + 1;
+        if (numRoutedFrameWords == frameWords)
+        {
+            numRoutedFrameWords = 0;
+            RouteRequestedFrame(routedFrame, frameWords);
+        }
+    }
+}
+
+PRResult PRDevice::CollectAndSortReturningData()
 {
     int32_t num_bytes, num_words;
-    uint32_t rd_buffer[FTDI_BUFFER_SIZE/4];
 
     num_bytes = CollectReadData();
     if (num_bytes < 0)
@@ -1310,39 +2122,193 @@ PRResult PRDevice::SortReturningData()
         PRSetLastErrorText("Error in CollectReadData: %d", num_bytes);
         return kPRFailure;
     }
+    if (num_bytes > 0)
+        collectTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
     num_words = num_collected_bytes/4;
 
     while (num_words >= 2) {
-        ReadData(rd_buffer, 1);
-        DEBUG(PRLog(kPRLogVerbose, "New returning word: 0x%x\n", rd_buffer[0]));
-
-        switch ( (rd_buffer[0] & P_ROC_COMMAND_MASK) >> P_ROC_COMMAND_SHIFT)
-        {
-            case P_ROC_REQUESTED_DATA: {
-                // Push the address word so it can be used to identify the subsequent data.
-                requestedDataQueue.push(rd_buffer[0]);
-                int wordsRead = ReadData(rd_buffer,
-                                         (rd_buffer[0] & P_ROC_HEADER_LENGTH_MASK) >>
-                                         P_ROC_HEADER_LENGTH_SHIFT);
-                for (int i = 0; i < wordsRead; i++)
-                {
-                    DEBUG(PRLog(kPRLogVerbose, "Pushing onto unreq Q 0x%x\n", rd_buffer[i]));
-                    requestedDataQueue.push(rd_buffer[i]);
-                }
+        uint32_t header = PeekCollectedWord(0);
+        DEBUG(PRLog(kPRLogVerbose, "New returning word: 0x%x\n", header));
+
+        if (((header & P_ROC_COMMAND_MASK) >> P_ROC_COMMAND_SHIFT) == P_ROC_REQUESTED_DATA) {
+            int32_t length = (header & P_ROC_HEADER_LENGTH_MASK) >> P_ROC_HEADER_LENGTH_SHIFT;
+            // Leave a partially received response in the fifo until the
+            // rest of it arrives.  The largest response (2047 words plus
+            // the address word) fits in the fifo exactly.
+            if (num_words < length + 1)
                 break;
-            }
-            case P_ROC_UNREQUESTED_DATA: {
-                ReadData(rd_buffer,1);
-                DEBUG(PRLog(kPRLogVerbose, "Pushing onto unreq Q 0x%x\n", rd_buffer[0]));
-                unrequestedDataQueue.push(rd_buffer[0]);
-                break;
-            }
+            // The address word goes first so the reply can be matched to its read.
+            for (int32_t i = 0; i <= length; i++)
+                collectedFrame[i] = PeekCollectedWord(i);
+            ConsumeCollectedWords(length + 1);
+            QueueRequestedFrame(collectedFrame, length + 1);
+        }
+        else {
+            uint32_t word = PeekCollectedWord(1);
+            DEBUG(PRLog(kPRLogVerbose, "Pushing onto unreq Q 0x%x\n", word));
+            QueueUnrequestedWord(word);
+            ConsumeCollectedWords(2);
         }
         num_words = num_collected_bytes/4;
     }
     return kPRSuccess;
 }
 
+void PRDevice::QueueRequestedFrame(const uint32_t *frame, int32_t numWords)
+{
+    if (!ioThreadRunning)
+    {
+        RouteRequestedFrame(frame, numWords);
+        return;
+    }
+    ioThreadWordsReceived += numWords;
+    // The application is probably waiting for this reply, so give it a
+    // moment to make room.  Waiting any longer would stall events and
+    // writes behind a reply nobody reads; drop it whole instead, so the
+    // frames after it stay intact.
+    std::chrono::steady_clock::time_point giveUpAt = std::chrono::steady_clock::now() + std::chrono::microseconds(ioThreadRequestedWaitUs);
+    while (requestedRing->Space() < (uint32_t)numWords)
+    {
+        if (ioThreadStop || std::chrono::steady_clock::now() >= giveUpAt)
+        {
+            ioThreadDroppedRequestedWords += numWords;
+            return;
+        }
+        std::this_thread::yield();
+    }
+    requestedRing->Push(frame, numWords);
+    ioThreadNewRequested = true;
+}
+
+void PRDevice::QueueUnrequestedWord(uint32_t word)
+{
+    PREventStamp stamp;
+    stamp.hostTimeNs = collectTimeNs;
+    stamp.sequence = nextEventSequence++;
+
+    if (!ioThreadRunning)
+    {
+        if (unrequestedDataQueue.Push(word))
+            unrequestedStamps.Push(stamp);
+        else if (stats.eventsDropped++ == 0)
+            DEBUG(PRLog(kPRLogWarning, "Event queue full; dropping events until PRGetEvents() catches up\n"));
+        return;
+    }
+    ioThreadWordsReceived++;
+    ioThreadNewEvents = true;
+    PREvent event;
+    PREventEx eventEx;
+    decodeEvents(&event, &word, 1);
+    FillEventEx(&eventEx, &event, &stamp);
+    if (!eventRing->Push(eventEx) && ioThreadDroppedEvents++ == 0)
+        DEBUG(PRLog(kPRLogWarning, "Event ring full; dropping events until PRGetEvents() catches up\n"));
+}
+
+PRResult PRDevice::StartIOThread()
+{
+    if (ioThreadRunning)
+        return kPRSuccess;
+
+    // Anything already prepared goes out before the thread takes over.
+    if (FlushWriteData() != kPRSuccess)
+        return kPRFailure;
+
+    writeRing = new PRRing<uint32_t>(ioThreadWriteRingWords);
+    requestedRing = new PRRing<uint32_t>(requestedDataQueue.Capacity());
+    eventRing = new PRRing<PREventEx>(unrequestedDataQueue.Capacity());
+
+#if defined(__linux__)
+    eventFDRead = eventFDWrite = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#elif !defined(_MSC_VER)
+    int fds[2];
+    if (pipe(fds) == 0)
+    {
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        eventFDRead = fds[0];
+        eventFDWrite = fds[1];
+    }
+#endif
+
+    ioThreadStop = false;
+    ioThreadRunning = true;
+    ioThread = std::thread(&PRDevice::IOThreadMain, this);
+    DEBUG(PRLog(kPRLogInfo, "I/O thread started\n"));
+    return kPRSuccess;
+}
+
+void PRDevice::StopIOThread()
+{
+    if (!ioThreadRunning)
+        return;
+
+    ioThreadStop = true;
+    ioThreadWake.notify_one();
+    ioThread.join();
+    ioThreadRunning = false;
+
+    // Hand back anything the application hasn't picked up yet.
+    RouteRequestedRing();
+    numRoutedFrameWords = 0;
+
+#ifndef _MSC_VER
+    if (eventFDWrite >= 0 && eventFDWrite != eventFDRead)
+        close(eventFDWrite);
+    if (eventFDRead >= 0)
+        close(eventFDRead);
+#endif
+    eventFDRead = eventFDWrite = -1;
+
+    delete writeRing;
+    delete requestedRing;
+    delete eventRing;
+    writeRing = NULL;
+    requestedRing = NULL;
+    eventRing = NULL;
+    DEBUG(PRLog(kPRLogInfo, "I/O thread stopped\n"));
+}
+
+void PRDevice::IOThreadMain()
+{
+    uint32_t words[sizeof(wr_buffer) / 4];
+    uint32_t numWords;
+
+    while (!ioThreadStop)
+    {
+        numWords = writeRing->Pop(words, sizeof(wr_buffer) / 4);
+        if (numWords > 0 && TransportWrite(words, numWords) != kPRSuccess)
+            DEBUG(PRLog(kPRLogError, "I/O thread: %s\n", PRGetLastErrorText()));
+
+        uint32_t numReceivedBefore = ioThreadWordsReceived;
+        ioThreadNewEvents = false;
+        ioThreadNewRequested = false;
+        if (CollectAndSortReturningData() != kPRSuccess)
+            DEBUG(PRLog(kPRLogError, "I/O thread: %s\n", PRGetLastErrorText()));
+        if (ioThreadNewEvents)
+            SignalEvents();
+        if (ioThreadNewRequested)
+        {
+            // Taking the lock orders the push before a waiter's predicate check.
+            { std::lock_guard<std::mutex> lock(requestedMutex); }
+            requestedCond.notify_one();
+        }
+
+        // Nothing moved in either direction: wait for the application to
+        // queue a write, or 1 ms before polling the transport again.  A
+        // notify that races with the wait is picked up by the timeout.
+        if (numWords == 0 && ioThreadWordsReceived == numReceivedBefore && writeRing->Size() == 0)
+        {
+            std::unique_lock<std::mutex> lock(ioThreadMutex);
+            ioThreadWake.wait_for(lock, std::chrono::milliseconds(1));
+        }
+    }
+
+    // Don't lose commands queued just before PRDelete().
+    while ((numWords = writeRing->Pop(words, sizeof(wr_buffer) / 4)) > 0)
+        TransportWrite(words, numWords);
+}
+
 int PRDevice::CalcCombinedVerRevision()
 {
     combinedVersionRevision = (version * 0x10000) + revision;
@@ -1357,134 +2323,202 @@ int PRDevice::GetVersionInfo(uint16_t *verPtr, uint16_t *revPtr, uint32_t *combi
     return 0;
 }
 
-PRResult PRDevice::PRLEDColor(PRLED * pLED, uint8_t color)
+PRSimulator *PRDevice::GetSimulator()
 {
-    const int bufferWords = 2;
-    uint32_t buffer[bufferWords];
-
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->boardAddr, kPRLEDRegisterTypeColor, color, buffer);
+    return dynamic_cast<PRSimulator *>(transport);
+}
 
-    return PrepareWriteData(buffer, bufferWords);
+PRResult PRDevice::PRLEDColor(PRLED * pLED, uint8_t color)
+{
+    LEDWriteRegister(pLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->LEDIndex);
+    return LEDWriteRegister(pLED->boardAddr, kPRLEDRegisterTypeColor, color);
 }
 
 PRResult PRDevice::PRLEDFade(PRLED * pLED, uint8_t fadeColor, uint16_t fadeRate)
 {
-    const int bufferWords = 2;
-    uint32_t buffer[bufferWords];
-
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->LEDIndex);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->boardAddr, kPRLEDRegisterTypeFadeColor, fadeColor, buffer);
-    return PrepareWriteData(buffer, bufferWords);
+    return LEDWriteRegister(pLED->boardAddr, kPRLEDRegisterTypeFadeColor, fadeColor);
 
 }
 
 PRResult PRDevice::PRLEDFadeColor(PRLED * pLED, uint8_t fadeColor)
 {
-    const int bufferWords = 2;
-    uint32_t buffer[bufferWords];
-
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->boardAddr, kPRLEDRegisterTypeFadeColor, fadeColor, buffer);
-    return PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->LEDIndex);
+    return LEDWriteRegister(pLED->boardAddr, kPRLEDRegisterTypeFadeColor, fadeColor);
 
 }
 
 PRResult PRDevice::PRLEDFadeRate(uint8_t boardAddr, uint16_t fadeRate)
 {
-    const int bufferWords = 2;
-    uint32_t buffer[bufferWords];
-
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF, buffer);
-    return PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF);
+    return LEDWriteRegister(boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF);
 }
 
 PRResult PRDevice::PRLEDRGBColor(PRLEDRGB * pLED, uint32_t color)
 {
-    const int bufferWords = 2;
-    uint32_t buffer[bufferWords];
+    LEDWriteRegister(pLED->pRedLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pRedLED->LEDIndex);
+    LEDWriteRegister(pLED->pRedLED->boardAddr, kPRLEDRegisterTypeColor, (color >> 16) & 0xFF);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pRedLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pRedLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pRedLED->boardAddr, kPRLEDRegisterTypeColor, (color >> 16) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pGreenLED->LEDIndex);
+    LEDWriteRegister(pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeColor, (color >> 8) & 0xFF);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pGreenLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeColor, (color >> 8) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
-
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pBlueLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeColor, color & 0xFF, buffer);
-    return PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pBlueLED->LEDIndex);
+    return LEDWriteRegister(pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeColor, color & 0xFF);
 }
 
 PRResult PRDevice::PRLEDRGBFade(PRLEDRGB * pLED, uint32_t fadeColor, uint16_t fadeRate)
 {
-    const int bufferWords = 12;
-    uint32_t buffer[bufferWords];
+    LEDWriteRegister(pLED->pRedLED->boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF);
+    LEDWriteRegister(pLED->pRedLED->boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pRedLED->boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pRedLED->boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->pRedLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pRedLED->LEDIndex);
+    LEDWriteRegister(pLED->pRedLED->boardAddr, kPRLEDRegisterTypeFadeColor, (fadeColor >> 16) & 0xFF);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pRedLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pRedLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pRedLED->boardAddr, kPRLEDRegisterTypeFadeColor, (fadeColor >> 16) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF);
+    LEDWriteRegister(pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pGreenLED->LEDIndex);
+    LEDWriteRegister(pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeFadeColor, (fadeColor >> 8) & 0xFF);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pGreenLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeFadeColor, (fadeColor >> 8) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF);
+    LEDWriteRegister(pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF);
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeFadeRateLow, fadeRate & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeFadeRateHigh, (fadeRate >> 8) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
-
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pBlueLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeFadeColor, fadeColor & 0xFF, buffer);
-    return PrepareWriteData(buffer, bufferWords);
+    LEDWriteRegister(pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pBlueLED->LEDIndex);
+    return LEDWriteRegister(pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeFadeColor, fadeColor & 0xFF);
 }
 
 PRResult PRDevice::PRLEDRGBFadeColor(PRLEDRGB * pLED, uint32_t fadeColor)
 {
-    const int bufferWords = 2;
-    uint32_t buffer[bufferWords];
+    LEDWriteRegister(pLED->pRedLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pRedLED->LEDIndex);
+    LEDWriteRegister(pLED->pRedLED->boardAddr, kPRLEDRegisterTypeFadeColor, (fadeColor >> 16) & 0xFF);
+
+    LEDWriteRegister(pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pGreenLED->LEDIndex);
+    LEDWriteRegister(pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeFadeColor, (fadeColor >> 8) & 0xFF);
+
+    LEDWriteRegister(pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pBlueLED->LEDIndex);
+    return LEDWriteRegister(pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeFadeColor, fadeColor & 0xFF);
+}
+
+PRResult PRDevice::PRLEDUpdateFrame(const PRLEDFrameEntry * entries, int32_t numEntries)
+{
+    const uint32_t commandBytes = 8; // Burst header and PDB command word.
+
+    for (int32_t i = 0; i < numEntries; i++)
+    {
+        const PRLEDFrameEntry *entry = &entries[i];
+        if (entry->boardAddr >= maxPDLEDBoards)
+        {
+            PRSetLastErrorText("PD-LED board address %d out of range", entry->boardAddr);
+            return kPRFailure;
+        }
+
+        PDLEDBoardShadow *board = &ledShadow[entry->boardAddr];
+        bool fade = entry->fadeRate != 0;
+        uint32_t state = fade ? (ledShadowFade | entry->color | (entry->fadeRate << 16)) : (ledShadowColor | entry->color);
+        uint32_t numCommands = 0;
+
+        if (board->leds.empty() || board->leds[entry->LEDIndex] != state)
+        {
+            if (fade && (board->fadeRateLow != (entry->fadeRate & 0xFF) || board->fadeRateHigh != (entry->fadeRate >> 8)))
+            {
+                if (LEDWriteRegister(entry->boardAddr, kPRLEDRegisterTypeFadeRateLow, entry->fadeRate & 0xFF) != kPRSuccess ||
+                    LEDWriteRegister(entry->boardAddr, kPRLEDRegisterTypeFadeRateHigh, (entry->fadeRate >> 8) & 0xFF) != kPRSuccess)
+                    return kPRFailure;
+                numCommands += 2;
+            }
+            if (board->ledIndex != entry->LEDIndex)
+            {
+                if (LEDWriteRegister(entry->boardAddr, kPRLEDRegisterTypeLEDIndex, entry->LEDIndex) != kPRSuccess)
+                    return kPRFailure;
+                numCommands++;
+            }
+            if (LEDWriteRegister(entry->boardAddr, fade ? kPRLEDRegisterTypeFadeColor : kPRLEDRegisterTypeColor, entry->color) != kPRSuccess)
+                return kPRFailure;
+            numCommands++;
+        }
+
+        // PRLEDColor() sends an index and a color; PRLEDFade() adds the fade rate.
+        uint32_t fullCommands = fade ? 4 : 2;
+        stats.ledBytesSent += numCommands * commandBytes;
+        stats.ledBytesSaved += (fullCommands - numCommands) * commandBytes;
+    }
+    return kPRSuccess;
+}
+
+void PRDevice::LEDShadowReset()
+{
+    for (int i = 0; i < maxPDLEDBoards; i++)
+    {
+        ledShadow[i].ledIndex = -1;
+        ledShadow[i].fadeRateLow = -1;
+        ledShadow[i].fadeRateHigh = -1;
+        ledShadow[i].leds.clear();
+    }
+}
+
+void PRDevice::LEDShadowNote(uint8_t boardAddr, PRLEDRegisterType reg, uint8_t value)
+{
+    if (boardAddr == P_ROC_DRIVER_PDB_BROADCAST_ADDR)
+    {
+        for (int i = 0; i < maxPDLEDBoards; i++)
+            LEDShadowNote(i, reg, value);
+        return;
+    }
+    if (boardAddr >= maxPDLEDBoards)
+    {
+        // No telling which board the address reaches.
+        LEDShadowReset();
+        return;
+    }
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pRedLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pRedLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pRedLED->boardAddr, kPRLEDRegisterTypeFadeColor, (fadeColor >> 16) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
+    PDLEDBoardShadow *board = &ledShadow[boardAddr];
+    switch (reg)
+    {
+        case kPRLEDRegisterTypeLEDIndex:
+            board->ledIndex = value;
+            break;
+        case kPRLEDRegisterTypeColor:
+        case kPRLEDRegisterTypeFadeColor:
+            if (board->ledIndex < 0)
+            {
+                // Some LED on the board changed, but not one we know of.
+                board->leds.clear();
+                break;
+            }
+            if (board->leds.empty())
+                board->leds.assign(maxPDLEDs, ledShadowUnknown);
+            if (reg == kPRLEDRegisterTypeColor)
+                board->leds[board->ledIndex] = ledShadowColor | value;
+            else if (board->fadeRateLow < 0 || board->fadeRateHigh < 0)
+                board->leds[board->ledIndex] = ledShadowUnknown; // Fading at a rate we don't know.
+            else
+                board->leds[board->ledIndex] = ledShadowFade | value | (board->fadeRateLow << 16) | (board->fadeRateHigh << 24);
+            break;
+        case kPRLEDRegisterTypeFadeRateLow:
+            board->fadeRateLow = value;
+            break;
+        case kPRLEDRegisterTypeFadeRateHigh:
+            board->fadeRateHigh = value;
+            break;
+    }
+}
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pGreenLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pGreenLED->boardAddr, kPRLEDRegisterTypeFadeColor, (fadeColor >> 8) & 0xFF, buffer);
-    PrepareWriteData(buffer, bufferWords);
+PRResult PRDevice::LEDWriteRegister(uint8_t boardAddr, PRLEDRegisterType reg, uint8_t value)
+{
+    const int bufferWords = 2;
+    uint32_t buffer[bufferWords];
 
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeLEDIndex, pLED->pBlueLED->LEDIndex, buffer);
-    PrepareWriteData(buffer, bufferWords);
-    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, pLED->pBlueLED->boardAddr, kPRLEDRegisterTypeFadeColor, fadeColor & 0xFF, buffer);
-    return PrepareWriteData(buffer, bufferWords);
+    FillPDBCommand(P_ROC_DRIVER_PDB_WRITE_COMMAND, boardAddr, reg, value, buffer);
+    if (PrepareWriteData(buffer, bufferWords) != kPRSuccess)
+    {
+        LEDShadowReset();
+        return kPRFailure;
+    }
+    LEDShadowNote(boardAddr, reg, value);
+    return kPRSuccess;
 }
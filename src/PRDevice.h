@@ -36,7 +36,15 @@
 #include "pinproc.h"
 #include "PRCommon.h"
 #include "PRHardware.h"
-#include <queue>
+#include "PRTransport.h"
+#include "PRRing.h"
+#include "PREventDecoder.h"
+#include "PRDMDCompositor.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstddef>
 
 using namespace std;
 
@@ -44,24 +52,66 @@ using namespace std;
 #define maxDrivers (256)
 #define maxSwitchRules (256<<2) // 8 bits of switchNum indicies plus bits for debounced and state.
 #define maxWriteWords (1536) // Hardware supports 2048 word bursts, but restrict to 1536 for margin.
+#define ioThreadWriteRingWords (8192)
+#define ioThreadRequestedWaitUs (10000) // How long the I/O thread waits for room in requestedRing before dropping a reply.
+#define minRequestedDataQueueSize (2048) // Longest response the device sends: 2047 data words plus the address word.
+#define waitForEventsPollUs (250) // Transport polling interval for WaitForEvents() without an I/O thread.
+#define requestedDataSpinUs (200)      // Poll without sleeping this long before backing off.
+#define requestedDataPollMinUs (50)    // First back-off step while waiting for requested data.
+#define requestedDataPollMaxUs (1000)  // Longest step; the back-off doubles up to this.
+#define requestedDataTimeoutUs (100000) // How long reads wait for a reply by default.
+#define maxPendingReads (256)
+#define maxReadWords (2047) // Longest burst the device returns.
+#define maxReadsPerRequest (64) // Read request words sent in one write by ReadDataMulti().
+#define maxQueuedDMDFrames (16) // Frames PRDMDQueueFrame() holds before refusing more.
+#define maxPDLEDBoards (63) // PDB board addresses; 63 (P_ROC_DRIVER_PDB_BROADCAST_ADDR) reaches every board.
+#define maxPDLEDs (256)     // Width of a PD-LED board's LED index register.
+
+class PRSimulator;
+class PRDMDAnimation;
+
+/** What PRGetEventsEx() needs to know about an event word beyond the word itself, recorded as it's received. */
+struct PREventStamp
+{
+    uint64_t hostTimeNs;
+    uint64_t sequence;
+};
+
+/** A read that has been requested from the device and not yet answered. */
+struct PRPendingRead
+{
+    uint32_t key;            /**< Request word without the command bit; the reply's address word matches it. */
+    uint32_t moduleSelect;
+    uint32_t startingAddr;
+    PRReadCallback callback; /**< NULL for a synchronous read, whose reply goes to requestedDataQueue. */
+    void *userData;
+    bool abandoned;          /**< Given up on; the reply is counted as late and dropped. */
+};
 
 class PRDevice
 {
 public:
-    static PRDevice *Create(PRMachineType machineType);
+    static PRDevice *Create(PRMachineType machineType, PRCreateOptions *options);
     ~PRDevice();
     PRResult Reset(uint32_t resetFlags);
 protected:
-    PRDevice(PRMachineType machineType);
+    PRDevice(PRMachineType machineType, PRTransport *transport, PRCreateOptions *options);
 
 public:
     // public libpinproc API:
     int GetEvents(PREvent *events, int maxEvents);
+    int GetEventsEx(PREventEx *events, int maxEvents);
+    int WaitForEvents(uint32_t timeoutUs);
+    int GetEventFD();
+    PRResult GetStats(PRStats *stats);
 
     PRResult FlushWriteData();
     PRResult WriteDataRaw(uint32_t moduleSelect, uint32_t startingAddr, int32_t numWriteWords, uint32_t * buffer);
     PRResult WriteDataRawUnbuffered(uint32_t moduleSelect, uint32_t startingAddr, int32_t numWriteWords, uint32_t * buffer);
-    PRResult ReadDataRaw(uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, uint32_t * readBuffer);
+    PRResult ReadDataRaw(uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, uint32_t * readBuffer, uint32_t timeoutUs = requestedDataTimeoutUs);
+    PRResult ReadDataMulti(PRReadRequest *requests, int32_t numRequests, uint32_t timeoutUs = requestedDataTimeoutUs);
+    PRResult ReadDataAsync(uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, PRReadCallback callback, void *userData);
+    int WaitForReads(uint32_t timeoutUs);
 
     PRResult ManagerUpdateConfig(PRManagerConfig *managerConfig);
 
@@ -80,6 +130,16 @@ public:
 
     PRResult DMDUpdateConfig(PRDMDConfig *dmdConfig);
     PRResult DMDDraw(uint8_t * dots);
+    PRResult DMDSetColorMap(const uint8_t * colorMap, int32_t numEntries);
+    PRResult DMDSetFrameDiffing(bool enable);
+    PRResult DMDDrawPixels(const uint8_t * pixels, uint32_t stride, bool useColorMap);
+    PRResult DMDQueueFrame(const uint8_t * dots, uint64_t displayTimeNs);
+    PRResult DMDQueueClear();
+    PRResult DMDQueueGetStatus(PRDMDQueueStatus * status);
+    PRResult DMDPlayAnimation(PRDMDAnimation * animation, bool loop);
+    PRResult DMDStopAnimation();
+    int32_t DMDAnimationCurrentFrame();
+    PRResult DMDComposite();
 
     PRResult PRJTAGDriveOutputs(PRJTAGOutputs * jtagOutputs, bool_t toggleClk);
     PRResult PRJTAGWriteTDOMemory(uint16_t tableOffset, uint16_t numWords, uint32_t * tdoData);
@@ -94,9 +154,13 @@ public:
     PRResult PRLEDRGBColor(PRLEDRGB * pLED, uint32_t color);
     PRResult PRLEDRGBFade(PRLEDRGB * pLED, uint32_t fadeColor, uint16_t fadeRate);
     PRResult PRLEDRGBFadeColor(PRLEDRGB * pLED, uint32_t fadeColor);
+    PRResult PRLEDUpdateFrame(const PRLEDFrameEntry * entries, int32_t numEntries);
 
     int GetVersionInfo(uint16_t *verPtr, uint16_t *revPtr, uint32_t *combinedPtr);
 
+    PRSimulator *GetSimulator(); /**< NULL unless the transport is #kPRTransportSimulator. */
+    PRDMDCompositor *GetDMDCompositor() { return &dmdCompositor; }
+
 protected:
 
     // Device I/O
@@ -104,6 +168,40 @@ protected:
     PRResult Open();
     PRResult Close();
 
+    PRTransport *transport; /**< Owned by this device; all USB (or simulated) I/O goes through it. */
+
+    // Background I/O thread (PRCreateOptions::useIOThread).  While it runs it
+    // is the only thread that touches the transport, wr_buffer and the
+    // collected bytes; the application thread talks to it through the rings.
+
+    PRResult StartIOThread();
+    void StopIOThread();
+    void IOThreadMain();
+
+    bool ioThreadRunning;
+    std::atomic<bool> ioThreadStop;
+    std::thread ioThread;
+    std::mutex ioThreadMutex;
+    std::condition_variable ioThreadWake; /**< Signalled when words are added to writeRing. */
+    PRRing<uint32_t> *writeRing;      /**< Application -> I/O thread: words to send. */
+    PRRing<uint32_t> *requestedRing;  /**< I/O thread -> application: whole requested data frames, address words included. */
+    PRRing<PREventEx> *eventRing;     /**< I/O thread -> application: decoded unrequested data. */
+    std::atomic<uint32_t> ioThreadDroppedEvents; /**< Read by GetStats() on the application thread. */
+    std::atomic<uint32_t> ioThreadDroppedRequestedWords; /**< Likewise, for replies requestedRing had no room for. */
+    uint32_t ioThreadWordsReceived;   /**< Lets the I/O thread tell whether a pass did any work. */
+    bool ioThreadNewEvents;           /**< Set when a pass pushed into eventRing. */
+    bool ioThreadNewRequested;        /**< Set when a pass pushed into requestedRing. */
+    std::mutex requestedMutex;
+    std::condition_variable requestedCond; /**< Signalled when requested data reaches requestedRing; see WaitForRequestedData(). */
+
+    // Event notification for WaitForEvents() and GetEventFD() while the I/O thread runs.
+    void SignalEvents();
+    void ClearEventSignal();
+    std::mutex eventMutex;
+    std::condition_variable eventCond;
+    int eventFDRead;   /**< Readable while events are waiting in eventRing; -1 if unsupported. */
+    int eventFDWrite;  /**< Same descriptor as eventFDRead when eventfd() is available. */
+
     PRResult VerifyChipID();
     PRMachineType GetReadMachineType();
 
@@ -112,42 +210,113 @@ protected:
 
     /** Schedules data to be written to the P-ROC.  */
     PRResult PrepareWriteData(uint32_t * buffer, int32_t numWords);
+    /**
+     * Makes room for numWords words at the end of preparedWriteWords, flushing first if they won't fit,
+     * and returns where to put them.  Returns NULL on failure.
+     */
+    uint32_t *ReservePreparedWords(int32_t numWords);
 
-    /** Writes data to the P-ROC immediately. */
-    PRResult WriteData(uint32_t * buffer, int32_t numWords);
-
+    /** Writes data to the P-ROC immediately, or hands it to the I/O thread if one is running. */
+    PRResult WriteData(const uint32_t * buffer, int32_t numWords);
     /**
-     * Reads data from the buffer that was previously collected by CollectReadData().
-     * Returns the number of bytes read.
+     * Like WriteData() for a header word followed by its payload, without first gathering them into one buffer.
+     * With flushPrepared, preparedWriteWords go out first, in the same transfer.
      */
-    int32_t ReadData(uint32_t *buffer, int32_t maxWords);
+    PRResult WriteBurst(uint32_t header, const uint32_t * payload, int32_t numPayloadWords, bool flushPrepared = false);
+    /** Byte-swaps into wr_buffer and writes to the transport. */
+    PRResult TransportWrite(const uint32_t * buffer, int32_t numWords);
+    /** Writes the first numBytes of wr_buffer to the transport. */
+    PRResult TransportWriteBuffer(int numBytes);
 
     // Collection of methods to get data returning from the P-ROC
     /**
      * Request a block of data from the P-ROC.
+     * The request is appended to preparedWriteWords and flushed with them,
+     * so it goes out in the same transfer as any buffered writes.
+     * The reply is routed to requestedDataQueue.
      */
     PRResult RequestData(uint32_t module_select, uint32_t start_addr, int32_t num_words);
+    /** Requests several blocks in one write; the replies arrive in order. */
+    PRResult RequestData(const PRReadRequest *requests, int32_t numRequests);
+    /**
+     * Polls until requestedDataQueue holds at least numWords words or timeoutUs passes.
+     * On timeout the outstanding synchronous reads are abandoned and requestedDataQueue is emptied.
+     */
+    PRResult WaitForRequestedData(uint32_t numWords, uint32_t timeoutUs);
+    /**
+     * Sorts returning data until done() returns true or timeoutUs passes.
+     * Spins for requestedDataSpinUs, then backs off from requestedDataPollMinUs to
+     * requestedDataPollMaxUs between polls (or blocks on requestedCond with an I/O thread).
+     * Returns 1 once done, 0 on timeout (without setting the error text) or -1 if sorting fails.
+     */
+    template <typename Done> int WaitForReplies(uint32_t timeoutUs, Done done);
     /**
-     * Actually reads the data off of the FTDI chip.
+     * Actually reads the data off of the FTDI chip, straight into the free
+     * space of collected_bytes_fifo.
      * This is called by SortReturningData() in order to get some data to process.
      */
     int32_t CollectReadData();
+    /** Returns the word at collected_bytes_rd_addr + 4*index, converted from wire order in place. */
+    uint32_t PeekCollectedWord(int32_t index);
+    /** Drops numWords whole words from the front of collected_bytes_fifo. */
+    void ConsumeCollectedWords(int32_t numWords);
     /**
      * Processes data into unrequestedDataQueue and requestedDataQueue.
-     * Calls CollectReadData() to obtain the data and then uses ReadData() to read it out.
+     * Calls CollectReadData() to obtain the data and then decodes complete
+     * packets directly out of collected_bytes_fifo.
      */
     PRResult SortReturningData();
+    /** Reads from the transport and sorts the words; the body of SortReturningData() without an I/O thread. */
+    PRResult CollectAndSortReturningData();
+    /** Routes a reply, or with an I/O thread hands it to the application through requestedRing. */
+    void QueueRequestedFrame(const uint32_t *frame, int32_t numWords);
+    /** Routes the replies waiting in requestedRing. */
+    void RouteRequestedRing();
+    void QueueUnrequestedWord(uint32_t word);
     /**
      * Empties out the read buffer.
-     * Calls CollectReadData() and then ReadData() until it's empty.
+     * Calls CollectReadData() and then discards everything collected.
      */
     PRResult FlushReadBuffer();
 
-    queue<uint32_t> unrequestedDataQueue; /**< Queue of words received from the device that were not requested via RequestData().  Usually switch events. */
-    queue<uint32_t> requestedDataQueue; /**< Queue of words received from the device as the result of a call to RequestData(). */
+    // Preallocated when the handle is created (PRCreateOptions sizes); nothing
+    // on the receive path allocates.  Without an I/O thread both ends of each
+    // ring are on the application thread.
+    PRRing<uint32_t> unrequestedDataQueue; /**< Queue of words received from the device that were not requested via RequestData().  Usually switch events. */
+    PRRing<uint32_t> requestedDataQueue; /**< Queue of words received from the device as the result of a call to RequestData(). */
+    PRRing<PREventStamp> unrequestedStamps; /**< One per word in unrequestedDataQueue, pushed and popped in step with it. */
+
+    // Reads awaiting replies, oldest first.  The device answers in request
+    // order, so each reply is matched against the front of the table.
+    // Only touched on the application thread.
+    PRPendingRead pendingReads[maxPendingReads];
+    uint32_t pendingReadsHead;
+    uint32_t numPendingReads;
+    PRResult AddPendingRead(uint32_t requestWord, uint32_t moduleSelect, uint32_t startingAddr, PRReadCallback callback, void *userData);
+    /** Gives up on the outstanding synchronous reads, and the asynchronous ones too if includeAsync is set.  Returns the number given up on. */
+    int AbandonPendingReads(bool includeAsync);
+    int NumOutstandingAsyncReads();
+    /** Hands a complete reply (address word first) to the read it answers. */
+    void RouteRequestedFrame(const uint32_t *frame, int32_t numWords);
+    uint32_t collectedFrame[maxReadWords + 1]; /**< Reply being copied out of collected_bytes_fifo. */
+    uint32_t routedFrame[maxReadWords + 1];    /**< Reply being reassembled from requestedRing. */
+    int32_t numRoutedFrameWords;
+
+    // PRGetEventsEx() bookkeeping.  Updated by whichever thread receives
+    // events: the I/O thread if there is one, otherwise the application.
+    uint64_t collectTimeNs;       /**< Host time of the last CollectReadData() that returned data. */
+    uint64_t nextEventSequence;
+    uint64_t lastDeviceTime;      /**< Latest unwrapped event time seen. */
+    uint32_t eventTimeMasks[kPREventTypeAccelerometerIRQ + 1]; /**< Per PREventType, from PREventTimeBits(); set with decodeEvents. */
+    void SetEventFormat(uint16_t version);
+    uint64_t UnwrapEventTime(const PREvent *event);
+    void FillEventEx(PREventEx *eventEx, const PREvent *event, const PREventStamp *stamp);
+
+    PRStats stats; /**< Counters updated on the application thread; GetStats() adds in the I/O thread's. */
 
     uint16_t version;
     uint16_t revision;
+    PREventDecoder decodeEvents; /**< Matches version; chosen by VerifyChipID(). */
     uint32_t chip_id;
     uint32_t combinedVersionRevision;
     /**
@@ -158,13 +327,18 @@ protected:
     uint32_t preparedWriteWords[maxWriteWords];
     int32_t numPreparedWriteWords;
 
+    // Receive ring.  The transport reads directly into its free space (at most
+    // two contiguous segments) and packets are decoded where they land.  The
+    // read side only ever moves by whole words, so with a power-of-two size
+    // that is a multiple of 4 no word straddles the wrap.  Words are read
+    // with byte loads, so the fifo needs no alignment of its own; aligning
+    // it would over-align PRDevice (see the static_assert below).
     uint8_t collected_bytes_fifo[FTDI_BUFFER_SIZE];
     int32_t collected_bytes_rd_addr;
     int32_t collected_bytes_wr_addr;
     int32_t num_collected_bytes;
 
     uint8_t wr_buffer[16384];
-    uint8_t collect_buffer[FTDI_BUFFER_SIZE];
     PRMachineType readMachineType;
 
 
@@ -175,11 +349,67 @@ protected:
     PRDriverGroupConfig driverGroups[maxDriverGroups];
     PRDriverState drivers[maxDrivers];
     PRDMDConfig dmdConfig;
+    // What DMDDraw() last sent to each hardware frame buffer, so unchanged
+    // words can be skipped.  Sized by DMDUpdateConfig().
+    std::vector<uint32_t> dmdShadow;
+    std::vector<bool> dmdShadowValid;
+    uint32_t dmdWriteBuffer; /**< Buffer the device's write pointer is on. */
+    bool dmdDiffEnabled;     /**< Set by DMDSetFrameDiffing(); off by default. */
+    uint8_t dmdColorMap[256];     /**< Pixel value to subframe bits for DMDDrawPixels(). */
+    bool dmdColorMapSet;          /**< False while dmdColorMap is the default DMDUpdateConfig() derives. */
+    std::vector<uint8_t> dmdPixelFrame; /**< Dots encoded by DMDDrawPixels(); sized by DMDUpdateConfig(). */
+    void SetDefaultDMDColorMap();
+    // Frame queue.  Frames wait in a ring of maxQueuedDMDFrames slots and go
+    // out through DMDDraw(), one per frame event; dmdQueueCredits counts the
+    // hardware buffers free to take one.
+    std::vector<uint8_t> dmdQueueFrames;
+    uint64_t dmdQueueTimes[maxQueuedDMDFrames];
+    uint32_t dmdQueueHead;
+    uint32_t dmdQueueCount;
+    uint32_t dmdQueueCredits;
+    bool dmdQueueMissed[maxQueuedDMDFrames]; /**< Was already due at an earlier frame event. */
+    PRDMDQueueStatus dmdQueueStatus;
+    uint32_t DMDQueueMaxCredits();
+    void DMDQueueReset();
+    template <typename Event> void DMDQueueNoteEvents(const Event *events, int numEvents);
+    PRResult ServiceDMDQueue(bool frameEvent);
+    // Animation player.  Shares the queue's buffer credits; while it plays,
+    // queued frames wait.
+    PRDMDAnimation *dmdAnimation;
+    bool dmdAnimationLoop;
+    uint32_t dmdAnimationNext;    /**< Index entry to send at the next frame event. */
+    uint32_t dmdAnimationHold;    /**< Frame events left before it goes. */
+    PRResult ServiceDMDAnimation();
+    /** Points dmdAnimation at animation (or NULL), moving the reference from the old one to the new. */
+    void SetDMDAnimation(PRDMDAnimation *animation);
+    PRDMDCompositor dmdCompositor;
+    std::vector<uint8_t> dmdComposite; /**< Pixels the compositor blends into; sized by DMDUpdateConfig(). */
+
+    // PD-LED shadow.  What each board's registers hold as far as the writes
+    // made through LEDWriteRegister() tell, so PRLEDUpdateFrame() can skip
+    // writes that change nothing.
+    enum { ledShadowUnknown = 0, ledShadowColor = 0x100, ledShadowFade = 0x200 };
+    struct PDLEDBoardShadow
+    {
+        int16_t ledIndex;       /**< LED index register, or -1 if unknown. */
+        int16_t fadeRateLow;    /**< Fade rate registers, or -1 if unknown. */
+        int16_t fadeRateHigh;
+        std::vector<uint32_t> leds; /**< Per LED, ledShadowColor plus the color, or ledShadowFade plus the fade color and the fade rate << 16; empty until the first write. */
+    };
+    PDLEDBoardShadow ledShadow[maxPDLEDBoards];
+    void LEDShadowReset();
+    void LEDShadowNote(uint8_t boardAddr, PRLEDRegisterType reg, uint8_t value);
+    /** Prepares a PDB write to one PD-LED register and records it in ledShadow. */
+    PRResult LEDWriteRegister(uint8_t boardAddr, PRLEDRegisterType reg, uint8_t value);
 
     PRSwitchConfig switchConfig;
     PRSwitchRuleInternal switchRules[maxSwitchRules];
-	queue<uint32_t> freeSwitchRuleIndexes; /**< Indexes of available switch rules. */
+    PRRing<uint16_t> freeSwitchRuleIndexes; /**< Indexes of available switch rules. */
     PRSwitchRuleInternal *GetSwitchRuleByIndex(uint16_t index);
 };
 
+// PRDevice::Create() allocates with plain new, which only guarantees the
+// default alignment before C++17; the rings it embeds pad rather than align.
+static_assert(alignof(PRDevice) <= alignof(std::max_align_t), "PRDevice must not be over-aligned");
+
 #endif	/* PINPROC_PRDEVICE_H */
@@ -0,0 +1,133 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PREventDecoder.cpp
+ *  libpinproc
+ */
+
+#include "PREventDecoder.h"
+
+// Every field of an event word is found with a shift and mask that depend only
+// on the 2-bit event type, so decoding is a handful of table lookups per word
+// with no branches.  The tables are indexed by type << 2 | sub, where sub is
+// the debounced and open bits for switch events and the axis for
+// accelerometer events.
+
+struct PREventFormatV1
+{
+    static const uint32_t typeMask = P_ROC_V1_EVENT_TYPE_MASK;
+    static const uint32_t typeShift = P_ROC_V1_EVENT_TYPE_SHIFT;
+    static const uint32_t switchNumMask = P_ROC_V1_EVENT_SWITCH_NUM_MASK;
+    static const uint32_t switchStateShift = P_ROC_V1_EVENT_SWITCH_STATE_SHIFT;
+    static const uint32_t switchDebouncedShift = P_ROC_V1_EVENT_SWITCH_DEBOUNCED_SHIFT;
+    static const uint32_t timestampMask = P_ROC_V1_EVENT_SWITCH_TIMESTAMP_MASK;
+    static const uint32_t timestampShift = P_ROC_V1_EVENT_SWITCH_TIMESTAMP_SHIFT;
+};
+
+struct PREventFormatV2
+{
+    static const uint32_t typeMask = P_ROC_V2_EVENT_TYPE_MASK;
+    static const uint32_t typeShift = P_ROC_V2_EVENT_TYPE_SHIFT;
+    static const uint32_t switchNumMask = P_ROC_V2_EVENT_SWITCH_NUM_MASK;
+    static const uint32_t switchStateShift = P_ROC_V2_EVENT_SWITCH_STATE_SHIFT;
+    static const uint32_t switchDebouncedShift = P_ROC_V2_EVENT_SWITCH_DEBOUNCED_SHIFT;
+    static const uint32_t timestampMask = P_ROC_V2_EVENT_SWITCH_TIMESTAMP_MASK;
+    static const uint32_t timestampShift = P_ROC_V2_EVENT_SWITCH_TIMESTAMP_SHIFT;
+};
+
+#define kAccelValueMask (0x3FFF)
+#define kAccelAxisShift (16)
+#define kAccelTimeExtraShift (2) // Accelerometer events carry the axis in the low timestamp bits.
+
+static const PREventType eventTypeTable[16] = {
+    // P_ROC_EVENT_TYPE_SWITCH: closed, open, closed debounced, open debounced
+    kPREventTypeSwitchClosedNondebounced, kPREventTypeSwitchOpenNondebounced,
+    kPREventTypeSwitchClosedDebounced, kPREventTypeSwitchOpenDebounced,
+    // P_ROC_EVENT_TYPE_DMD
+    kPREventTypeDMDFrameDisplayed, kPREventTypeDMDFrameDisplayed,
+    kPREventTypeDMDFrameDisplayed, kPREventTypeDMDFrameDisplayed,
+    // P_ROC_EVENT_TYPE_BURST_SWITCH: only the open bit matters
+    kPREventTypeBurstSwitchClosed, kPREventTypeBurstSwitchOpen,
+    kPREventTypeBurstSwitchClosed, kPREventTypeBurstSwitchOpen,
+    // P_ROC_EVENT_TYPE_ACCELEROMETER: X, Y, Z, IRQ
+    kPREventTypeAccelerometerX, kPREventTypeAccelerometerY,
+    kPREventTypeAccelerometerZ, kPREventTypeAccelerometerIRQ,
+};
+
+template <class Format>
+static int PRDecodeEvents(PREvent *events, const uint32_t *words, int numWords)
+{
+    static_assert(Format::switchDebouncedShift == Format::switchStateShift + 1,
+                  "the open and debounced bits must be adjacent");
+
+    static const uint8_t subShift[4] = {
+        Format::switchStateShift, Format::switchStateShift,
+        Format::switchStateShift, kAccelAxisShift
+    };
+    static const uint32_t valueMask[4] = {
+        Format::switchNumMask, Format::switchNumMask,
+        Format::switchNumMask, kAccelValueMask
+    };
+    static const uint8_t timeShift[4] = {
+        Format::timestampShift, Format::timestampShift,
+        Format::timestampShift, Format::timestampShift + kAccelTimeExtraShift
+    };
+
+    for (int i = 0; i < numWords; i++)
+    {
+        uint32_t word = words[i];
+        uint32_t type = (word & Format::typeMask) >> Format::typeShift;
+        uint32_t sub = (word >> subShift[type]) & 3;
+
+        events[i].type = eventTypeTable[(type << 2) | sub];
+        events[i].value = word & valueMask[type];
+        events[i].time = (word & Format::timestampMask) >> timeShift[type];
+    }
+    return numWords;
+}
+
+int PRDecodeEventsV1(PREvent *events, const uint32_t *words, int numWords)
+{
+    return PRDecodeEvents<PREventFormatV1>(events, words, numWords);
+}
+
+int PRDecodeEventsV2(PREvent *events, const uint32_t *words, int numWords)
+{
+    return PRDecodeEvents<PREventFormatV2>(events, words, numWords);
+}
+
+PREventDecoder PREventDecoderForVersion(uint16_t version)
+{
+    return version >= 2 ? PRDecodeEventsV2 : PRDecodeEventsV1;
+}
+
+int PREventTimeBits(uint16_t version, PREventType type)
+{
+    int bits = version >= 2 ? 32 - P_ROC_V2_EVENT_SWITCH_TIMESTAMP_SHIFT : 32 - P_ROC_V1_EVENT_SWITCH_TIMESTAMP_SHIFT;
+    if (type >= kPREventTypeAccelerometerX && type <= kPREventTypeAccelerometerIRQ)
+        bits -= kAccelTimeExtraShift;
+    return bits;
+}
@@ -0,0 +1,53 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PREventDecoder.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PREVENTDECODER_H
+#define PINPROC_PREVENTDECODER_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+#include "pinproc.h"
+
+/**
+ * Decodes numWords unrequested data words into events[0..numWords-1].
+ * Returns numWords.  The event word layout changed with FPGA version 2, so
+ * PRDevice picks one of these once the chip's version is known.
+ */
+typedef int (*PREventDecoder)(PREvent *events, const uint32_t *words, int numWords);
+
+PREventDecoder PREventDecoderForVersion(uint16_t version);
+/** Number of bits in a decoded event's time before it wraps. */
+int PREventTimeBits(uint16_t version, PREventType type);
+
+int PRDecodeEventsV1(PREvent *events, const uint32_t *words, int numWords);
+int PRDecodeEventsV2(PREvent *events, const uint32_t *words, int numWords);
+
+#endif /* PINPROC_PREVENTDECODER_H */
@@ -31,6 +31,8 @@
 #include <stdlib.h>
 #include "PRHardware.h"
 #include "PRCommon.h"
+#include "PRTransport.h"
+#include "PRDMDTiming.h"
 
 bool_t IsStern (uint32_t hardware_data) {
 //    if ( ((hardware_data & P_ROC_BOARD_VERSION_MASK) >> P_ROC_BOARD_VERSION_SHIFT) == 0x1)
@@ -297,10 +299,7 @@ int32_t CreateDMDUpdateConfigBurst ( uint32_t * burst, PRDMDConfig *dmd_config)
     burst[2] = CreateBurstCommand (P_ROC_BUS_DMD_SELECT, addr, 4 );
 
     for (i=0; i<4; i++) {
-        burst[i+3] = (dmd_config->rclkLowCycles[i] << P_ROC_DMD_RCLK_LOW_CYCLES_SHIFT) |
-        (dmd_config->latchHighCycles[i] << P_ROC_DMD_LATCH_HIGH_CYCLES_SHIFT) |
-        (dmd_config->deHighCycles[i] << P_ROC_DMD_DE_HIGH_CYCLES_SHIFT) |
-        (dmd_config->dotclkHalfPeriod[i] << P_ROC_DMD_DOTCLK_HALF_PERIOD_SHIFT);
+        burst[i+3] = PRDMDTimingWord(dmd_config, i);
     }
     return kPRSuccess;
 }
@@ -357,32 +356,42 @@ void FillPDBCommand(uint8_t command, uint8_t boardAddr, PRLEDRegisterType reg, u
 
 /**
  * This is where all FTDI driver-specific code should go.
- * As we add support for other drivers (such as D2xx on Windows), we will add more implementations of the PRHardware*() functions here.
+ * Each backend implements PRTransport so that every PRDevice owns its own
+ * connection; see PRTransport.h.
  */
 
 #if defined(__WIN32__) || defined(_WIN32)
 #include "ftd2xx.h"
 
 #define BUF_SIZE 16
-#define MAX_DEVICES 1
+#define MAX_DEVICES 8
 
-// Globals
-static FT_HANDLE ftHandles[MAX_DEVICES];
-static FT_HANDLE ftHandle;
+class PRTransportFTDI : public PRTransport
+{
+public:
+    PRTransportFTDI(uint32_t deviceIndex) : deviceIndex(deviceIndex), ftHandle(NULL) {}
+    ~PRTransportFTDI() { Close(); }
+
+    PRResult Open();
+    void Close();
+    int Read(uint8_t *buffer, int maxBytes);
+    int Write(uint8_t *buffer, int bytes);
+
+protected:
+    uint32_t deviceIndex;
+    FT_HANDLE ftHandle;
+};
 
-PRResult PRHardwareOpen()
+PRResult PRTransportFTDI::Open()
 {
-    char 	cBufWrite[BUF_SIZE];
     char * 	pcBufLD[MAX_DEVICES + 1];
     char 	cBufLD[MAX_DEVICES][64];
     FT_STATUS	ftStatus;
     int	iNumDevs = 0;
-    int	i, j;
-    int	iDevicesOpen = 0;
+    int	i;
 
     for(i = 0; i < MAX_DEVICES; i++) {
         pcBufLD[i] = cBufLD[i];
-        ftHandles[i] = NULL;
     }
     pcBufLD[MAX_DEVICES] = NULL;
 
@@ -394,64 +403,50 @@ PRResult PRHardwareOpen()
         return kPRFailure;
     }
 
-    for(j = 0; j < BUF_SIZE; j++) {
-        cBufWrite[j] = j;
-    }
-
     for(i = 0; ( (i <MAX_DEVICES) && (i < iNumDevs) ); i++) {
         DEBUG(PRLog(kPRLogInfo,"Device %d Serial Number - %s\n", i, cBufLD[i]));
     }
 
-    for(i = 0; ( (i <MAX_DEVICES) && (i < iNumDevs) ) ; i++) {
-        /* Setup */
-        if((ftStatus = FT_OpenEx(cBufLD[i], FT_OPEN_BY_SERIAL_NUMBER, &ftHandles[i])) != FT_OK){
-            /*
-                This can fail if the ftdi_sio driver is loaded
-                use lsmod to check this and rmmod ftdi_sio to remove
-                also rmmod usbserial
-            */
-            DEBUG(PRLog(kPRLogInfo,"Error FT_OpenEx(%d), device\n", ftStatus, i));
-            PRSetLastErrorText("Error FT_OpenEx(%d), device\n", ftStatus, i);
-            return kPRFailure;
-        }
+    if (deviceIndex >= MAX_DEVICES || (int)deviceIndex >= iNumDevs)
+    {
+        PRSetLastErrorText("No FTDI device found at index %d.", deviceIndex);
+        return kPRFailure;
+    }
 
-        DEBUG(PRLog(kPRLogInfo,"Opened device %s\n", cBufLD[i]));
-        ftHandle = ftHandles[i];
+    /* Setup */
+    if((ftStatus = FT_OpenEx(cBufLD[deviceIndex], FT_OPEN_BY_SERIAL_NUMBER, &ftHandle)) != FT_OK){
+        /*
+            This can fail if the ftdi_sio driver is loaded
+            use lsmod to check this and rmmod ftdi_sio to remove
+            also rmmod usbserial
+        */
+        DEBUG(PRLog(kPRLogInfo,"Error FT_OpenEx(%d), device %d\n", ftStatus, deviceIndex));
+        PRSetLastErrorText("Error FT_OpenEx(%d), device %d\n", ftStatus, deviceIndex);
+        ftHandle = NULL;
+        return kPRFailure;
+    }
 
-        if((ftStatus = FT_SetBaudRate(ftHandles[i], 1228800)) != FT_OK) {
-            DEBUG(PRLog(kPRLogInfo,"Error FT_SetBaudRate(%d), cBufLD[i] = %s\n", ftStatus, cBufLD[i]));
-        }
+    DEBUG(PRLog(kPRLogInfo,"Opened device %s\n", cBufLD[deviceIndex]));
 
-        iDevicesOpen++;
+    if((ftStatus = FT_SetBaudRate(ftHandle, 1228800)) != FT_OK) {
+        DEBUG(PRLog(kPRLogInfo,"Error FT_SetBaudRate(%d), cBufLD[i] = %s\n", ftStatus, cBufLD[deviceIndex]));
     }
 
-    if (iDevicesOpen > 0)
-    {
-      FT_ResetDevice(ftHandle);
-      DEBUG(PRLog(kPRLogInfo,"FTDI Device Opened\n"));
-      return kPRSuccess;
-    }
-    else
-    {
-        PRSetLastErrorText("No FTDI device found.");
-        return kPRFailure;
-    }
+    FT_ResetDevice(ftHandle);
+    DEBUG(PRLog(kPRLogInfo,"FTDI Device Opened\n"));
+    return kPRSuccess;
 }
 
-void PRHardwareClose()
+void PRTransportFTDI::Close()
 {
-    int i;
-
-    for(i = 0; i < MAX_DEVICES; i++) {
-        if(ftHandles[i] != NULL) {
-            FT_Close(ftHandles[i]);
-            ftHandles[i] = NULL;
-            DEBUG(PRLog(kPRLogInfo,"Closed device\n"));
-        }
+    if(ftHandle != NULL) {
+        FT_Close(ftHandle);
+        ftHandle = NULL;
+        DEBUG(PRLog(kPRLogInfo,"Closed device\n"));
     }
 }
 
-int PRHardwareRead(uint8_t *buffer, int maxBytes)
+int PRTransportFTDI::Read(uint8_t *buffer, int maxBytes)
 {
     FT_STATUS ftStatus;
     DWORD bytesToRead;
@@ -473,7 +468,7 @@ int PRHardwareRead(uint8_t *buffer, int maxBytes)
     else return 0;
 }
 
-int PRHardwareWrite(uint8_t *buffer, int bytes)
+int PRTransportFTDI::Write(uint8_t *buffer, int bytes)
 {
     FT_STATUS ftStatus=0;
     DWORD bytesWritten=0;
@@ -498,16 +493,30 @@ int PRHardwareWrite(uint8_t *buffer, int bytes)
 #else // WIN32
 
 #include <libftdi1/ftdi.h>
+#include <vector>
 
-static bool ftdiInitialized;
-static ftdi_context ftdic;
-
+class PRTransportFTDI : public PRTransport
+{
+public:
+    PRTransportFTDI(uint32_t deviceIndex) : deviceIndex(deviceIndex), ftdiInitialized(false) {}
+    ~PRTransportFTDI() { Close(); }
+
+    PRResult Open();
+    void Close();
+    int Read(uint8_t *buffer, int maxBytes);
+    int Write(uint8_t *buffer, int bytes);
+
+protected:
+    uint32_t deviceIndex;
+    bool ftdiInitialized;
+    ftdi_context ftdic;
+};
 
-PRResult PRHardwareOpen()
+PRResult PRTransportFTDI::Open()
 {
     int32_t i=0;
     PRResult rc;
-    struct ftdi_device_list *devlist, *curdev;
+    struct ftdi_device_list *curdev;
     char manufacturer[128], description[128];
 
     ftdiInitialized = false;
@@ -520,24 +529,26 @@ PRResult PRHardwareOpen()
     }
 
     // Find all FTDI devices
-    // This is very basic and really only expects to see 1 device.  It needs to be
-    // smarter.  At the very least, it should check some register on the P-ROC versus
+    // This is very basic; deviceIndex picks among the attached boards in
+    // enumeration order, FT245RL boards first, then FT240X.  It should check some
+    // register on the P-ROC versus
     // an input parameter to ensure the software is set up for the same architecture as
     // the P-ROC (Stern vs WPC).  Otherwise, it's possible to drive the coils the wrong
     // polarity and blow fuses or fry transistors and all other sorts of badness.
 
-    // We first enumerate all of the devices:
-    int numDevices = ftdi_usb_find_all(&ftdic, &devlist, FTDI_VENDOR_ID, FTDI_FT245RL_PRODUCT_ID);
-    if (numDevices <=0) numDevices = ftdi_usb_find_all(&ftdic, &devlist, FTDI_VENDOR_ID, FTDI_FT240X_PRODUCT_ID);
-    if (numDevices < 0) {
-        PRSetLastErrorText("ftdi_usb_find_all failed: %d: %s", numDevices, ftdi_get_error_string(&ftdic));
-        ftdi_deinit(&ftdic);
-        return kPRFailure;
-    }
-    else {
-        DEBUG(PRLog(kPRLogInfo, "Number of FTDI devices found: %d\n", numDevices));
-
-        for (curdev = devlist; curdev != NULL; i++) {
+    // We first enumerate all of the devices of both chips into one list:
+    const int productIDs[2] = { FTDI_FT245RL_PRODUCT_ID, FTDI_FT240X_PRODUCT_ID };
+    struct ftdi_device_list *devlists[2] = { NULL, NULL };
+    std::vector<struct libusb_device *> devices;
+    for (int p = 0; p < 2; p++) {
+        int numDevices = ftdi_usb_find_all(&ftdic, &devlists[p], FTDI_VENDOR_ID, productIDs[p]);
+        if (numDevices < 0) {
+            PRSetLastErrorText("ftdi_usb_find_all failed: %d: %s", numDevices, ftdi_get_error_string(&ftdic));
+            ftdi_list_free(&devlists[0]);
+            ftdi_deinit(&ftdic);
+            return kPRFailure;
+        }
+        for (curdev = devlists[p]; curdev != NULL; curdev = curdev->next, i++) {
             DEBUG(PRLog(kPRLogInfo, "Checking device %d\n", i));
             if ((rc = (int32_t)ftdi_usb_get_strings(&ftdic, curdev->dev, manufacturer, 128, description, 128, NULL, 0)) < 0) {
                 DEBUG(PRLog(kPRLogInfo, "  ftdi_usb_get_strings failed: %d: %s\n", rc, ftdi_get_error_string(&ftdic)));
@@ -547,17 +558,28 @@ PRResult PRHardwareOpen()
                 DEBUG(PRLog(kPRLogInfo, "  Manufacturer: %s\n", manufacturer));
                 DEBUG(PRLog(kPRLogInfo, "  Description: %s\n", description));
             }
-            curdev = curdev->next;
+            devices.push_back(curdev->dev);
         }
+    }
+    DEBUG(PRLog(kPRLogInfo, "Number of FTDI devices found: %d\n", (int)devices.size()));
 
+    if (deviceIndex >= devices.size())
+    {
+        PRSetLastErrorText("No FTDI device found at index %d.", deviceIndex);
+        rc = -1;
     }
+    else
+        rc = (int32_t)ftdi_usb_open_dev(&ftdic, devices[deviceIndex]);
 
-    // Don't need the device list anymore
-    ftdi_list_free (&devlist);
+    // Don't need the device lists anymore; an open device keeps its own reference.
+    ftdi_list_free(&devlists[0]);
+    ftdi_list_free(&devlists[1]);
 
-    if (((rc = (int32_t)ftdi_usb_open(&ftdic, FTDI_VENDOR_ID, FTDI_FT245RL_PRODUCT_ID)) < 0) && ((rc = (int32_t)ftdi_usb_open(&ftdic, FTDI_VENDOR_ID, FTDI_FT240X_PRODUCT_ID)) < 0))
+    if (rc < 0)
     {
-        PRSetLastErrorText("Unable to open ftdi device: %d: %s", rc, ftdi_get_error_string(&ftdic));
+        if (deviceIndex < devices.size())
+            PRSetLastErrorText("Unable to open ftdi device %d: %d: %s", deviceIndex, rc, ftdi_get_error_string(&ftdic));
+        ftdi_deinit(&ftdic);
         return kPRFailure;
     }
     else
@@ -581,23 +603,29 @@ PRResult PRHardwareOpen()
         }
     }
 }
-void PRHardwareClose()
+void PRTransportFTDI::Close()
 {
     if (ftdiInitialized)
     {
         ftdi_usb_close(&ftdic);
         ftdi_deinit(&ftdic);
+        ftdiInitialized = false;
     }
 }
-int PRHardwareRead(uint8_t *buffer, int maxBytes)
+int PRTransportFTDI::Read(uint8_t *buffer, int maxBytes)
 {
     //return 0;
     return ftdi_read_data(&ftdic, buffer, maxBytes);
 }
-int PRHardwareWrite(uint8_t *buffer, int bytes)
+int PRTransportFTDI::Write(uint8_t *buffer, int bytes)
 {
     //return 0;
     return ftdi_write_data(&ftdic, buffer, bytes);
 }
 
 #endif
+
+PRTransport *PRTransportFTDICreate(uint32_t deviceIndex)
+{
+    return new PRTransportFTDI(deviceIndex);
+}
@@ -94,9 +94,4 @@ int32_t CreateJTAGShiftTDODataBurst ( uint32_t * burst, uint16_t numBits, bool_t
 
 void FillPDBCommand(uint8_t command, uint8_t boardAddr, PRLEDRegisterType reg, uint8_t value, uint32_t * pData);
 
-PRResult PRHardwareOpen();
-void PRHardwareClose();
-int PRHardwareRead(uint8_t *buffer, int maxBytes);
-int PRHardwareWrite(uint8_t *buffer, int bytes);
-
 #endif /* PINPROC_PRHARDWARE_H */
@@ -0,0 +1,128 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRRing.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRRING_H
+#define PINPROC_PRRING_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * Lock-free single-producer/single-consumer ring buffer.
+ *
+ * Exactly one thread may call Push() and exactly one (possibly different)
+ * thread may call Pop().  The capacity is rounded up to a power of two so
+ * indexes wrap with a mask, and the producer and consumer indexes sit on
+ * separate cache lines so the two threads don't contend for them.
+ */
+template <typename T>
+class PRRing
+{
+public:
+    PRRing(uint32_t minCapacity) : head(0), tail(0)
+    {
+        uint32_t capacity = 1;
+        while (capacity < minCapacity)
+            capacity <<= 1;
+        mask = capacity - 1;
+        items = new T[capacity];
+    }
+    ~PRRing() { delete [] items; }
+
+    /** Copies up to count items in.  Returns the number copied; fewer than count if the ring filled up. */
+    uint32_t Push(const T *src, uint32_t count)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t space = mask + 1 - (h - tail.load(std::memory_order_acquire));
+        if (count > space)
+            count = space;
+        for (uint32_t i = 0; i < count; i++)
+            items[(h + i) & mask] = src[i];
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    /** Copies up to maxCount items out.  Returns the number copied. */
+    uint32_t Pop(T *dst, uint32_t maxCount)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t count = head.load(std::memory_order_acquire) - t;
+        if (count > maxCount)
+            count = maxCount;
+        for (uint32_t i = 0; i < count; i++)
+            dst[i] = items[(t + i) & mask];
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * Consumer side, without copying: points *first at the oldest waiting
+     * item and returns how many follow it contiguously (the rest, if any,
+     * start at the beginning of the storage).  Call Consume() when done.
+     */
+    uint32_t Peek(const T **first) const
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t count = head.load(std::memory_order_acquire) - t;
+        uint32_t toEnd = mask + 1 - (t & mask);
+        *first = &items[t & mask];
+        return count < toEnd ? count : toEnd;
+    }
+    void Consume(uint32_t count) { tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+
+    bool Push(const T &item) { return Push(&item, 1) == 1; }
+    bool Pop(T &item) { return Pop(&item, 1) == 1; }
+
+    /** Discards everything waiting.  Only safe when no other thread is using the ring. */
+    void Clear() { tail.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+
+    /** Number of items waiting.  Exact only when called from the producer or consumer thread. */
+    uint32_t Size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+    uint32_t Capacity() const { return mask + 1; }
+    uint32_t Space() const { return Capacity() - Size(); }
+
+private:
+    PRRing(const PRRing &);
+    PRRing &operator=(const PRRing &);
+
+    T *items;
+    uint32_t mask;
+    // Padding rather than alignas keeps head and tail a cache line apart
+    // without over-aligning the ring, which operator new doesn't honor
+    // before C++17.
+    char headPad[64];
+    std::atomic<uint32_t> head; /**< Next slot to write.  Written only by the producer. */
+    char tailPad[64 - sizeof(std::atomic<uint32_t>)];
+    std::atomic<uint32_t> tail; /**< Next slot to read.  Written only by the consumer. */
+};
+
+#endif /* PINPROC_PRRING_H */
@@ -0,0 +1,534 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRSimulator.cpp
+ *  libpinproc
+ */
+
+#include <string.h>
+#include "PRSimulator.h"
+#include "PRCommon.h"
+#include "PRDMDTiming.h"
+#include "PRHardware.h"
+
+#define kPRSimulatorMinFramePeriod (100)   // us; keeps an unconfigured DMD from flooding the event stream.
+
+PRTransport *PRSimulatorCreate(uint32_t chipID)
+{
+    return new PRSimulator(chipID == P3_ROC_CHIP_ID ? P3_ROC_CHIP_ID : P_ROC_CHIP_ID);
+}
+
+PRSimulator::PRSimulator(uint32_t chipID) : chipID(chipID), now(0)
+{
+}
+
+PRResult PRSimulator::Open()
+{
+    PRTransportMemory::Open();
+    registers[(P_ROC_MANAGER_SELECT << P_ROC_MODULE_SELECT_SHIFT) | P_ROC_REG_CHIP_ID_ADDR] = chipID;
+
+    actions.clear();
+    droppedEvents = 0;
+
+    // All switches start open and settled.
+    memset(switchState, 0xff, sizeof(switchState));
+    memset(switchDebounced, 0xff, sizeof(switchDebounced));
+    memset(switchGeneration, 0, sizeof(switchGeneration));
+    switchConfig = 0;
+    hostEventsEnable = false;
+
+    memset(rules, 0, sizeof(rules));
+    memset(drivers, 0, sizeof(drivers));
+    memset(driverGeneration, 0, sizeof(driverGeneration));
+
+    dmdConfig = 0;
+    memset(dmdTiming, 0, sizeof(dmdTiming));
+    dmdFrames.clear();
+    dmdFrameReady.clear();
+    dmdWriteBuffer = 0;
+    dmdDisplayBuffer = 0;
+    dmdNextFrame = 0;
+
+    memset(ledIndex, 0, sizeof(ledIndex));
+    memset(ledFadeRate, 0, sizeof(ledFadeRate));
+    memset(leds, 0, sizeof(leds));
+
+    DEBUG(PRLog(kPRLogInfo, "Simulator opened (chip ID 0x%x)\n", chipID));
+    return kPRSuccess;
+}
+
+int PRSimulator::Read(uint8_t *buffer, int maxBytes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return PRTransportMemory::Read(buffer, maxBytes);
+}
+
+int PRSimulator::Write(uint8_t *buffer, int bytes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return PRTransportMemory::Write(buffer, bytes);
+}
+
+uint64_t PRSimulator::GetTime()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return now;
+}
+
+void PRSimulator::ScheduleEvents(const PRSimulatorEvent *events, int numEvents)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (int i = 0; i < numEvents; i++)
+    {
+        Action action;
+        action.type = kActionScripted;
+        action.event = events[i];
+        action.generation = 0;
+        // multimap keeps insertion order for equal keys, so same-time events fire in script order.
+        actions.insert(std::make_pair(events[i].time < now ? now : events[i].time, action));
+    }
+}
+
+void PRSimulator::Advance(uint32_t microseconds)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t end = now + microseconds;
+
+    while (true)
+    {
+        uint64_t next = end + 1;
+        if (!actions.empty())
+            next = actions.begin()->first;
+        bool frameDue = dmdNextFrame != 0 && dmdNextFrame <= end && dmdNextFrame < next;
+        if (frameDue)
+            next = dmdNextFrame;
+        if (next > end)
+            break;
+
+        now = next;
+        if (frameDue)
+        {
+            DMDFrameTick();
+        }
+        else
+        {
+            Action action = actions.begin()->second;
+            actions.erase(actions.begin());
+            RunAction(action);
+        }
+    }
+    now = end;
+}
+
+void PRSimulator::RunAction(const Action &action)
+{
+    const PRSimulatorEvent &event = action.event;
+
+    switch (action.type)
+    {
+        case kActionScripted:
+            switch (event.type)
+            {
+                case kPRSimulatorEventSwitchClosed:
+                case kPRSimulatorEventSwitchOpen:
+                    if (event.number < kPRSimulatorMaxSwitches)
+                        SetSwitch(event.number, event.type == kPRSimulatorEventSwitchOpen);
+                    break;
+                case kPRSimulatorEventDMDFrame:
+                    QueueEvent((P_ROC_EVENT_TYPE_DMD << P_ROC_V2_EVENT_TYPE_SHIFT) |
+                               (event.number & P_ROC_V2_EVENT_SWITCH_NUM_MASK) |
+                               (TimeMs() << P_ROC_V2_EVENT_SWITCH_TIMESTAMP_SHIFT));
+                    break;
+                case kPRSimulatorEventAccelerometer:
+                    QueueEvent((P_ROC_EVENT_TYPE_ACCELEROMETER << P_ROC_V2_EVENT_TYPE_SHIFT) |
+                               (event.value & 0x3FFF) |
+                               ((event.number & 0x3) << 16) |
+                               (TimeMs() << P_ROC_V2_EVENT_ACCEL_TIMESTAMP_SHIFT));
+                    break;
+            }
+            break;
+
+        case kActionDebounce:
+            if (action.generation == switchGeneration[event.number])
+                DebounceSwitch(event.number);
+            break;
+
+        case kActionPulseEnd:
+            if (action.generation == driverGeneration[event.number])
+                drivers[event.number][0] &= ~(1 << P_ROC_DRIVER_CONFIG_STATE_SHIFT);
+            break;
+    }
+}
+
+void PRSimulator::SetSwitch(uint16_t switchNum, bool open)
+{
+    uint32_t bit = 1 << (switchNum % 32);
+    uint32_t &state = switchState[switchNum / 32];
+
+    if (((state & bit) != 0) == open)
+        return;
+
+    if (open)
+        state |= bit;
+    else
+        state &= ~bit;
+    switchDebounced[switchNum / 32] &= ~bit;
+    switchGeneration[switchNum]++;
+
+    if (switchNum <= kPRSwitchPhysicalLast)
+        ProcessRule((open << P_ROC_SWITCH_RULE_NUM_STATE_SHIFT) | switchNum);
+
+    if (switchNum >= kPRSwitchNeverDebounceFirst && switchNum <= kPRSwitchNeverDebounceLast)
+    {
+        DebounceSwitch(switchNum);
+    }
+    else
+    {
+        // The FPGA calls a switch debounced once it reads the same value on
+        // two consecutive scans.
+        uint32_t scanMs = (switchConfig >> P_ROC_SWITCH_CONFIG_MS_PER_DM_SCAN_LOOP_SHIFT) & 0x1F;
+        Action action;
+        action.type = kActionDebounce;
+        action.event.number = switchNum;
+        action.generation = switchGeneration[switchNum];
+        actions.insert(std::make_pair(now + 2000 * (scanMs ? scanMs : 1), action));
+    }
+}
+
+void PRSimulator::DebounceSwitch(uint16_t switchNum)
+{
+    uint32_t bit = 1 << (switchNum % 32);
+    bool open = (switchState[switchNum / 32] & bit) != 0;
+
+    switchDebounced[switchNum / 32] |= bit;
+    if (switchNum <= kPRSwitchPhysicalLast)
+        ProcessRule((1 << P_ROC_SWITCH_RULE_NUM_DEBOUNCE_SHIFT) |
+                    (open << P_ROC_SWITCH_RULE_NUM_STATE_SHIFT) | switchNum);
+}
+
+void PRSimulator::ProcessRule(uint16_t ruleIndex)
+{
+    uint32_t ruleWord = rules[ruleIndex][2];
+
+    if (hostEventsEnable && (ruleWord >> P_ROC_SWITCH_RULE_NOTIFY_HOST_SHIFT) & 1)
+    {
+        QueueEvent((P_ROC_EVENT_TYPE_SWITCH << P_ROC_V2_EVENT_TYPE_SHIFT) |
+                   (ruleIndex & 0xFF) |
+                   (((ruleIndex >> P_ROC_SWITCH_RULE_NUM_STATE_SHIFT) & 1) << P_ROC_V2_EVENT_SWITCH_STATE_SHIFT) |
+                   (((ruleIndex >> P_ROC_SWITCH_RULE_NUM_DEBOUNCE_SHIFT) & 1) << P_ROC_V2_EVENT_SWITCH_DEBOUNCED_SHIFT) |
+                   (TimeMs() << P_ROC_V2_EVENT_SWITCH_TIMESTAMP_SHIFT));
+    }
+
+    // Follow the chain of linked driver updates.  The chain length is
+    // bounded so a corrupt rule table can't hang the host.
+    for (int i = 0; i < kPRSwitchRulesCount; i++)
+    {
+        ruleWord = rules[ruleIndex][2];
+        if ((ruleWord >> P_ROC_SWITCH_RULE_CHANGE_OUTPUT_SHIFT) & 1)
+            SetDriver((ruleWord >> P_ROC_SWITCH_RULE_DRIVER_NUM_SHIFT) & 0x1FF,
+                      rules[ruleIndex][0], rules[ruleIndex][1]);
+        if (!((ruleWord >> P_ROC_SWITCH_RULE_LINK_ACTIVE_SHIFT) & 1))
+            break;
+        ruleIndex = (ruleWord >> P_ROC_SWITCH_RULE_LINK_ADDRESS_SHIFT) & (kPRSwitchRulesCount - 1);
+    }
+}
+
+void PRSimulator::SetDriver(uint16_t driverNum, uint32_t word0, uint32_t word1)
+{
+    if (driverNum >= kPRSimulatorMaxDrivers)
+        return;
+
+    drivers[driverNum][0] = word0;
+    drivers[driverNum][1] = word1;
+    driverGeneration[driverNum]++;
+
+    // A state change with a drive time and no schedule or patter is a pulse.
+    uint32_t driveTime = (word0 >> P_ROC_DRIVER_CONFIG_OUTPUT_DRIVE_TIME_SHIFT) & 0xFF;
+    uint32_t timeslots = (word0 >> P_ROC_DRIVER_CONFIG_TIMESLOT_SHIFT) | (word1 << 16);
+    if (((word0 >> P_ROC_DRIVER_CONFIG_STATE_SHIFT) & 1) && driveTime != 0 && timeslots == 0 &&
+        !((word1 >> P_ROC_DRIVER_CONFIG_PATTER_ENABLE_SHIFT) & 1))
+    {
+        Action action;
+        action.type = kActionPulseEnd;
+        action.event.number = driverNum;
+        action.generation = driverGeneration[driverNum];
+        actions.insert(std::make_pair(now + driveTime * 1000, action));
+    }
+}
+
+void PRSimulator::GetDriverState(uint16_t driverNum, PRDriverState *state)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t word0 = drivers[driverNum][0];
+    uint32_t word1 = drivers[driverNum][1];
+
+    state->driverNum = driverNum;
+    state->outputDriveTime = (word0 >> P_ROC_DRIVER_CONFIG_OUTPUT_DRIVE_TIME_SHIFT) & 0xFF;
+    state->polarity = (word0 >> P_ROC_DRIVER_CONFIG_POLARITY_SHIFT) & 1;
+    state->state = (word0 >> P_ROC_DRIVER_CONFIG_STATE_SHIFT) & 1;
+    state->waitForFirstTimeSlot = (word0 >> P_ROC_DRIVER_CONFIG_WAIT_4_1ST_SLOT_SHIFT) & 1;
+    state->timeslots = (word0 >> P_ROC_DRIVER_CONFIG_TIMESLOT_SHIFT) | (word1 << 16);
+    state->patterOnTime = (word1 >> P_ROC_DRIVER_CONFIG_PATTER_ON_TIME_SHIFT) & 0x7F;
+    state->patterOffTime = (word1 >> P_ROC_DRIVER_CONFIG_PATTER_OFF_TIME_SHIFT) & 0x7F;
+    state->patterEnable = (word1 >> P_ROC_DRIVER_CONFIG_PATTER_ENABLE_SHIFT) & 1;
+    state->futureEnable = (word1 >> P_ROC_DRIVER_CONFIG_FUTURE_ENABLE_SHIFT) & 1;
+}
+
+void PRSimulator::WriteRegister(uint32_t addr, uint32_t value)
+{
+    PRTransportMemory::WriteRegister(addr, value);
+
+    uint32_t module = (addr & P_ROC_MODULE_SELECT_MASK) >> P_ROC_MODULE_SELECT_SHIFT;
+    uint32_t regAddr = addr & P_ROC_REG_ADDR_MASK;
+
+    switch (module)
+    {
+        case P_ROC_BUS_SWITCH_CTRL_SELECT:
+            if (regAddr == 0)
+                switchConfig = value;
+            break;
+
+        case P_ROC_BUS_STATE_CHANGE_PROC_SELECT:
+            if (regAddr == P_ROC_STATE_CHANGE_CONFIG_ADDR)
+            {
+                hostEventsEnable = value & 1;
+            }
+            else if (regAddr < P_ROC_STATE_CHANGE_CONFIG_ADDR || (regAddr & (1 << P_ROC_SWITCH_RULE_DRIVE_OUTPUTS_NOW)))
+            {
+                uint32_t ruleIndex = (regAddr >> P_ROC_SWITCH_RULE_NUM_TO_ADDR_SHIFT) & (kPRSwitchRulesCount - 1);
+                uint32_t word = regAddr & 0x3;
+                if (word > 2)
+                    break;
+                rules[ruleIndex][word] = value;
+
+                // The rule word is last in the burst; drive-outputs-now applies
+                // the driver change if the switch is already in the rule's state.
+                if (word == 2 && (regAddr & (1 << P_ROC_SWITCH_RULE_DRIVE_OUTPUTS_NOW)) &&
+                    ((value >> P_ROC_SWITCH_RULE_CHANGE_OUTPUT_SHIFT) & 1))
+                {
+                    uint16_t switchNum = ruleIndex & 0xFF;
+                    uint32_t bit = 1 << (switchNum % 32);
+                    bool open = (switchState[switchNum / 32] & bit) != 0;
+                    bool debounced = (switchDebounced[switchNum / 32] & bit) != 0;
+                    bool ruleOpen = (ruleIndex >> P_ROC_SWITCH_RULE_NUM_STATE_SHIFT) & 1;
+                    bool ruleDebounced = (ruleIndex >> P_ROC_SWITCH_RULE_NUM_DEBOUNCE_SHIFT) & 1;
+                    if (open == ruleOpen && (debounced || !ruleDebounced))
+                        SetDriver((value >> P_ROC_SWITCH_RULE_DRIVER_NUM_SHIFT) & 0x1FF,
+                                  rules[ruleIndex][0], rules[ruleIndex][1]);
+                }
+            }
+            break;
+
+        case P_ROC_BUS_DRIVER_CTRL_SELECT:
+            if ((regAddr >> P_ROC_DRIVER_CTRL_DECODE_SHIFT) == P_ROC_DRIVER_CONFIG_TABLE_DECODE)
+            {
+                uint32_t driverNum = (regAddr >> P_ROC_DRIVER_CONFIG_TABLE_DRIVER_NUM_SHIFT) & 0x1FF;
+                if (regAddr & 1)
+                    SetDriver(driverNum, drivers[driverNum][0], value);
+                else
+                    drivers[driverNum][0] = value;
+            }
+            else if (regAddr == P_ROC_DRIVER_PDB_ADDR &&
+                     ((value >> P_ROC_DRIVER_PDB_COMMAND_SHIFT) & 0xFF) == P_ROC_DRIVER_PDB_WRITE_COMMAND)
+            {
+                uint8_t boardAddr = (value >> P_ROC_DRIVER_PDB_BOARD_ADDR_SHIFT) & 0xFF;
+                uint8_t reg = (value >> P_ROC_DRIVER_PDB_REGISTER_SHIFT) & 0xFF;
+                uint8_t data = (value >> P_ROC_DRIVER_PDB_DATA_SHIFT) & 0xFF;
+                if (boardAddr == P_ROC_DRIVER_PDB_BROADCAST_ADDR)
+                {
+                    for (boardAddr = 0; boardAddr < kPRSimulatorMaxLEDBoards; boardAddr++)
+                        LEDWriteRegister(boardAddr, reg, data);
+                }
+                else if (boardAddr < kPRSimulatorMaxLEDBoards)
+                    LEDWriteRegister(boardAddr, reg, data);
+            }
+            break;
+
+        case P_ROC_BUS_DMD_SELECT:
+            if (chipID != P_ROC_CHIP_ID)
+                break; // Module 5 is the aux controller on a P3-ROC.
+            if (regAddr == 0)
+            {
+                dmdConfig = value;
+                DMDWriteConfig();
+            }
+            else if (regAddr >= 8 && regAddr < 12)
+            {
+                // Timing follows the config word in the same burst, so
+                // restart the current frame with the new period.
+                dmdTiming[regAddr - 8] = value;
+                if (dmdNextFrame != 0)
+                    dmdNextFrame = now + DMDFramePeriod();
+            }
+            else if (regAddr >= P_ROC_DMD_DOT_TABLE_BASE_ADDR && !dmdFrames.empty())
+            {
+                std::vector<uint32_t> &frame = dmdFrames[dmdWriteBuffer];
+                uint32_t offset = regAddr - P_ROC_DMD_DOT_TABLE_BASE_ADDR;
+                if (offset >= frame.size())
+                    break;
+                frame[offset] = value;
+                if (offset == frame.size() - 1)
+                {
+                    dmdFrameReady[dmdWriteBuffer] = true;
+                    if ((dmdConfig >> P_ROC_DMD_AUTO_INC_WR_POINTER_SHIFT) & 1)
+                        dmdWriteBuffer = (dmdWriteBuffer + 1) % dmdFrames.size();
+                }
+            }
+            break;
+    }
+}
+
+uint32_t PRSimulator::ReadRegister(uint32_t addr)
+{
+    uint32_t module = (addr & P_ROC_MODULE_SELECT_MASK) >> P_ROC_MODULE_SELECT_SHIFT;
+    uint32_t regAddr = addr & P_ROC_REG_ADDR_MASK;
+
+    if (module == P_ROC_BUS_SWITCH_CTRL_SELECT)
+    {
+        uint32_t stateBase = chipID == P_ROC_CHIP_ID ? P_ROC_SWITCH_CTRL_STATE_BASE_ADDR : P3_ROC_SWITCH_CTRL_STATE_BASE_ADDR;
+        uint32_t debounceBase = chipID == P_ROC_CHIP_ID ? P_ROC_SWITCH_CTRL_DEBOUNCE_BASE_ADDR : P3_ROC_SWITCH_CTRL_DEBOUNCE_BASE_ADDR;
+        uint32_t numWords = debounceBase - stateBase;
+
+        if (regAddr >= stateBase && regAddr < stateBase + numWords)
+            return switchState[regAddr - stateBase];
+        if (regAddr >= debounceBase && regAddr < debounceBase + numWords)
+            return switchDebounced[regAddr - debounceBase];
+    }
+    else if (module == P_ROC_BUS_JTAG_SELECT && chipID == P_ROC_CHIP_ID && regAddr == P_ROC_JTAG_STATUS_REG_BASE_ADDR)
+    {
+        // Commands complete instantly.
+        return 1 << P_ROC_JTAG_STATUS_DONE_SHIFT;
+    }
+    return PRTransportMemory::ReadRegister(addr);
+}
+
+void PRSimulator::DMDWriteConfig()
+{
+    uint32_t columns = (dmdConfig >> P_ROC_DMD_NUM_COLUMNS_SHIFT) & 0xFF;
+    uint32_t rows = (dmdConfig >> P_ROC_DMD_NUM_ROWS_SHIFT) & 0xFF;
+    uint32_t subFrames = (dmdConfig >> P_ROC_DMD_NUM_SUB_FRAMES_SHIFT) & 0xFF;
+    uint32_t numBuffers = (dmdConfig >> P_ROC_DMD_NUM_FRAME_BUFFERS_SHIFT) & 0x1F;
+    uint32_t wordsPerFrame = (columns * rows / 32) * subFrames;
+
+    if (numBuffers == 0)
+        numBuffers = 1;
+    dmdFrames.assign(numBuffers, std::vector<uint32_t>(wordsPerFrame, 0));
+    dmdFrameReady.assign(numBuffers, false);
+    dmdWriteBuffer = 0;
+    dmdDisplayBuffer = 0;
+
+    if (((dmdConfig >> P_ROC_DMD_ENABLE_SHIFT) & 1) && wordsPerFrame > 0)
+        dmdNextFrame = now + DMDFramePeriod();
+    else
+        dmdNextFrame = 0;
+}
+
+void PRSimulator::LEDWriteRegister(uint8_t boardAddr, uint8_t reg, uint8_t value)
+{
+    // Color and fade color apply to the LED the index register selects.
+    PRSimulatorLEDState *led = &leds[boardAddr][ledIndex[boardAddr]];
+    switch (reg)
+    {
+        case kPRLEDRegisterTypeLEDIndex:
+            ledIndex[boardAddr] = value;
+            break;
+        case kPRLEDRegisterTypeColor:
+            led->color = value;
+            led->numWrites++;
+            break;
+        case kPRLEDRegisterTypeFadeColor:
+            led->fadeColor = value;
+            led->fadeRate = ledFadeRate[boardAddr];
+            led->numWrites++;
+            break;
+        case kPRLEDRegisterTypeFadeRateLow:
+            ledFadeRate[boardAddr] = (ledFadeRate[boardAddr] & 0xFF00) | value;
+            break;
+        case kPRLEDRegisterTypeFadeRateHigh:
+            ledFadeRate[boardAddr] = (ledFadeRate[boardAddr] & 0x00FF) | (value << 8);
+            break;
+    }
+}
+
+uint64_t PRSimulator::DMDFramePeriod()
+{
+    uint32_t columns = (dmdConfig >> P_ROC_DMD_NUM_COLUMNS_SHIFT) & 0xFF;
+    uint32_t rows = (dmdConfig >> P_ROC_DMD_NUM_ROWS_SHIFT) & 0xFF;
+    uint32_t subFrames = (dmdConfig >> P_ROC_DMD_NUM_SUB_FRAMES_SHIFT) & 0xFF;
+    uint64_t cycles = PRDMDFrameCycles(columns, rows, subFrames, dmdTiming);
+    uint64_t period = cycles * 1000000 / kPRDMDFPGAClockHz;
+    return period < kPRSimulatorMinFramePeriod ? kPRSimulatorMinFramePeriod : period;
+}
+
+void PRSimulator::DMDFrameTick()
+{
+    // Move on to the next buffer only once the host has finished writing it;
+    // otherwise the current frame is shown again.
+    uint32_t next = (dmdDisplayBuffer + 1) % dmdFrames.size();
+    if (dmdFrameReady[next])
+    {
+        dmdFrameReady[next] = false;
+        dmdDisplayBuffer = next;
+    }
+
+    if ((dmdConfig >> P_ROC_DMD_ENABLE_FRAME_EVENTS_SHIFT) & 1)
+        QueueEvent((P_ROC_EVENT_TYPE_DMD << P_ROC_V2_EVENT_TYPE_SHIFT) |
+                   dmdDisplayBuffer |
+                   (TimeMs() << P_ROC_V2_EVENT_SWITCH_TIMESTAMP_SHIFT));
+
+    dmdNextFrame = now + DMDFramePeriod();
+}
+
+int PRSimulator::GetDMDFrame(uint8_t frameBuffer, uint32_t *words, int maxWords)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (frameBuffer >= dmdFrames.size())
+        return 0;
+    int numWords = (int)dmdFrames[frameBuffer].size();
+    if (numWords > maxWords)
+        numWords = maxWords;
+    if (numWords > 0)
+        memcpy(words, &dmdFrames[frameBuffer][0], numWords * sizeof(uint32_t));
+    return numWords;
+}
+
+void PRSimulator::GetLEDState(uint8_t boardAddr, uint8_t LEDIndex, PRSimulatorLEDState *state)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    *state = leds[boardAddr][LEDIndex];
+}
+
+void PRSimulator::QueueEvent(uint32_t eventWord)
+{
+    if (readBytes.size() - readOffset + 8 > kPRSimulatorMaxReadBytes)
+    {
+        if (droppedEvents++ == 0)
+            DEBUG(PRLog(kPRLogWarning, "Simulator read buffer full; dropping events\n"));
+        return;
+    }
+    QueueWord((P_ROC_UNREQUESTED_DATA << P_ROC_COMMAND_SHIFT) | (1 << P_ROC_HEADER_LENGTH_SHIFT));
+    QueueWord(eventWord);
+}
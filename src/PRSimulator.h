@@ -0,0 +1,143 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRSimulator.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRSIMULATOR_H
+#define PINPROC_PRSIMULATOR_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include "PRTransportMemory.h"
+
+#define kPRSimulatorMaxSwitches (2048) // Width of the V2 event switch number field.
+#define kPRSimulatorMaxDrivers (512)
+#define kPRSimulatorMaxLEDBoards (63) // PDB board addresses; 63 is the broadcast address.
+#define kPRSimulatorMaxLEDs (256)     // Width of a PD-LED board's LED index register.
+#define kPRSimulatorMaxReadBytes (65536) // Pending response bytes before events are dropped, like a full FTDI FIFO.
+
+/**
+ * Software model of the P-ROC/P3-ROC register map.
+ *
+ * Builds on the memory transport's command decoding and adds the behavior
+ * behind the registers PRDevice uses: switch state and debounce words,
+ * switch rule memory (host notification, linked driver changes and
+ * drive-outputs-now), the driver config table with timed pulses, the DMD
+ * dot table and frame buffer pointers, the JTAG status register, and the
+ * PD-LED boards the driver controller passes PDB commands on to.
+ *
+ * Time is simulated in microseconds and only moves forward in Advance(), so
+ * a test script gets the same event stream on every run regardless of host
+ * load.  Events are returned through Read() framed as unrequested data,
+ * exactly as PRDevice::SortReturningData() expects from the FPGA.
+ */
+class PRSimulator : public PRTransportMemory
+{
+public:
+    PRSimulator(uint32_t chipID);
+
+    PRResult Open();
+    int Read(uint8_t *buffer, int maxBytes);
+    int Write(uint8_t *buffer, int bytes);
+
+    // The scripting calls below come from the application thread and may
+    // run concurrently with Read()/Write() on a handle's I/O thread.
+    void ScheduleEvents(const PRSimulatorEvent *events, int numEvents);
+    void Advance(uint32_t microseconds);
+    uint64_t GetTime();
+    void GetDriverState(uint16_t driverNum, PRDriverState *state);
+    int GetDMDFrame(uint8_t frameBuffer, uint32_t *words, int maxWords);
+    void GetLEDState(uint8_t boardAddr, uint8_t LEDIndex, PRSimulatorLEDState *state);
+
+protected:
+    void WriteRegister(uint32_t addr, uint32_t value);
+    uint32_t ReadRegister(uint32_t addr);
+
+private:
+    enum ActionType {
+        kActionScripted,       /**< A PRSimulatorEvent from the script. */
+        kActionDebounce,       /**< A switch has been stable long enough to be debounced. */
+        kActionPulseEnd        /**< A timed driver pulse has expired. */
+    };
+    struct Action {
+        ActionType type;
+        PRSimulatorEvent event;
+        uint32_t generation;   /**< Cancels stale debounce/pulse actions when the switch or driver changes again. */
+    };
+
+    void RunAction(const Action &action);
+    void SetSwitch(uint16_t switchNum, bool open);
+    void DebounceSwitch(uint16_t switchNum);
+    void ProcessRule(uint16_t ruleIndex);
+    void SetDriver(uint16_t driverNum, uint32_t word0, uint32_t word1);
+    void LEDWriteRegister(uint8_t boardAddr, uint8_t reg, uint8_t value);
+    void DMDWriteConfig();
+    void DMDFrameTick();
+    uint64_t DMDFramePeriod();
+    void QueueEvent(uint32_t eventWord);
+    uint32_t TimeMs() { return (uint32_t)(now / 1000); }
+
+    std::mutex lock;
+    uint32_t chipID;
+    uint64_t now;
+    std::multimap<uint64_t, Action> actions;
+    uint32_t droppedEvents;
+
+    // Switch controller
+    uint32_t switchState[kPRSimulatorMaxSwitches / 32];     /**< 1 = open. */
+    uint32_t switchDebounced[kPRSimulatorMaxSwitches / 32]; /**< 1 = the state bit has been debounced. */
+    uint32_t switchGeneration[kPRSimulatorMaxSwitches];
+    uint32_t switchConfig;
+    bool hostEventsEnable;
+
+    // State change processor
+    uint32_t rules[kPRSwitchRulesCount][3];
+
+    // Driver controller
+    uint32_t drivers[kPRSimulatorMaxDrivers][2];
+    uint32_t driverGeneration[kPRSimulatorMaxDrivers];
+
+    // DMD controller
+    uint32_t dmdConfig;
+    uint32_t dmdTiming[4];
+    std::vector<std::vector<uint32_t> > dmdFrames;
+    std::vector<bool> dmdFrameReady;
+    uint32_t dmdWriteBuffer;
+    uint32_t dmdDisplayBuffer;
+    uint64_t dmdNextFrame;     /**< 0 when the DMD is disabled. */
+
+    // PD-LED boards
+    uint8_t ledIndex[kPRSimulatorMaxLEDBoards];
+    uint16_t ledFadeRate[kPRSimulatorMaxLEDBoards];
+    PRSimulatorLEDState leds[kPRSimulatorMaxLEDBoards][kPRSimulatorMaxLEDs];
+};
+
+#endif /* PINPROC_PRSIMULATOR_H */
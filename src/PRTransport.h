@@ -0,0 +1,68 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRTransport.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRTRANSPORT_H
+#define PINPROC_PRTRANSPORT_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <stdint.h>
+#include "pinproc.h"
+
+/**
+ * Byte pipe between a PRDevice and the board.
+ * Each PRDevice owns exactly one transport, so every handle has its own
+ * connection state.  Data is exchanged in the FPGA's wire format: 32-bit
+ * words, most significant byte first.
+ */
+class PRTransport
+{
+public:
+    static PRTransport *Create(PRCreateOptions *options);
+    virtual ~PRTransport() {}
+
+    virtual PRResult Open() = 0;
+    virtual void Close() = 0;
+
+    /** Returns the number of bytes read (0 if none are available), or < 0 on error. */
+    virtual int Read(uint8_t *buffer, int maxBytes) = 0;
+    /** Returns the number of bytes written, or < 0 on error. */
+    virtual int Write(uint8_t *buffer, int bytes) = 0;
+
+    /** True if a physical board is attached on the other end. */
+    virtual bool IsHardware() { return true; }
+};
+
+// Backend constructors.  Each lives next to the code it wraps.
+PRTransport *PRTransportFTDICreate(uint32_t deviceIndex); // PRHardware.cpp
+PRTransport *PRTransportMemoryCreate(); // PRTransportMemory.cpp
+PRTransport *PRSimulatorCreate(uint32_t chipID); // PRSimulator.cpp
+
+#endif /* PINPROC_PRTRANSPORT_H */
@@ -0,0 +1,137 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRTransportMemory.cpp
+ *  libpinproc
+ */
+
+#include <string.h>
+#include "PRTransportMemory.h"
+#include "PRCommon.h"
+
+PRTransport *PRTransportMemoryCreate()
+{
+    return new PRTransportMemory();
+}
+
+PRTransportMemory::PRTransportMemory() : readOffset(0), partialWord(0), numPartialBytes(0), burstAddr(0), burstWordsLeft(0)
+{
+}
+
+PRResult PRTransportMemory::Open()
+{
+    registers.clear();
+    registers[(P_ROC_MANAGER_SELECT << P_ROC_MODULE_SELECT_SHIFT) | P_ROC_REG_CHIP_ID_ADDR] = P_ROC_CHIP_ID;
+    registers[(P_ROC_MANAGER_SELECT << P_ROC_MODULE_SELECT_SHIFT) | P_ROC_REG_VERSION_ADDR] = 2 << 16;
+    registers[(P_ROC_MANAGER_SELECT << P_ROC_MODULE_SELECT_SHIFT) | P_ROC_REG_DIPSWITCH_ADDR] = 1; // Not Stern
+    readBytes.clear();
+    readOffset = 0;
+    numPartialBytes = 0;
+    burstWordsLeft = 0;
+    DEBUG(PRLog(kPRLogInfo, "Memory transport opened\n"));
+    return kPRSuccess;
+}
+
+void PRTransportMemory::Close()
+{
+}
+
+int PRTransportMemory::Read(uint8_t *buffer, int maxBytes)
+{
+    int available = (int)(readBytes.size() - readOffset);
+    int numBytes = available < maxBytes ? available : maxBytes;
+
+    if (numBytes > 0)
+    {
+        memcpy(buffer, &readBytes[readOffset], numBytes);
+        readOffset += numBytes;
+    }
+    if (readOffset == readBytes.size())
+    {
+        readBytes.clear();
+        readOffset = 0;
+    }
+    return numBytes;
+}
+
+int PRTransportMemory::Write(uint8_t *buffer, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        partialWord = (partialWord << 8) | buffer[i];
+        if (++numPartialBytes == 4)
+        {
+            ProcessWord(partialWord);
+            partialWord = 0;
+            numPartialBytes = 0;
+        }
+    }
+    return bytes;
+}
+
+void PRTransportMemory::ProcessWord(uint32_t word)
+{
+    if (burstWordsLeft > 0)
+    {
+        WriteRegister(burstAddr++, word);
+        burstWordsLeft--;
+        return;
+    }
+
+    uint32_t addr = word & P_ROC_ADDR_MASK;
+    uint32_t numWords = (word & P_ROC_HEADER_LENGTH_MASK) >> P_ROC_HEADER_LENGTH_SHIFT;
+
+    if (((word & P_ROC_COMMAND_MASK) >> P_ROC_COMMAND_SHIFT) == P_ROC_WRITE)
+    {
+        burstAddr = addr;
+        burstWordsLeft = numWords;
+    }
+    else
+    {
+        QueueWord(word);
+        for (uint32_t i = 0; i < numWords; i++)
+            QueueWord(ReadRegister(addr + i));
+    }
+}
+
+void PRTransportMemory::WriteRegister(uint32_t addr, uint32_t value)
+{
+    registers[addr] = value;
+}
+
+uint32_t PRTransportMemory::ReadRegister(uint32_t addr)
+{
+    std::map<uint32_t, uint32_t>::iterator it = registers.find(addr);
+    return it == registers.end() ? 0 : it->second;
+}
+
+void PRTransportMemory::QueueWord(uint32_t word)
+{
+    readBytes.push_back((uint8_t)(word >> 24));
+    readBytes.push_back((uint8_t)(word >> 16));
+    readBytes.push_back((uint8_t)(word >> 8));
+    readBytes.push_back((uint8_t)word);
+}
@@ -0,0 +1,79 @@
+/*
+ * The MIT License
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  PRTransportMemory.h
+ *  libpinproc
+ */
+#ifndef PINPROC_PRTRANSPORTMEMORY_H
+#define PINPROC_PRTRANSPORTMEMORY_H
+#if !defined(__GNUC__) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4) || (__GNUC__ >= 4)	// GCC supports "pragma once" correctly since 3.4
+#pragma once
+#endif
+
+#include <map>
+#include <vector>
+#include "PRTransport.h"
+
+/**
+ * Loopback transport with no hardware behind it.
+ *
+ * Burst writes are stored in a flat register image keyed by
+ * {module select, address}.  Read requests are answered from that image
+ * with the same framing the FPGA uses: the request word echoed back as the
+ * address word, followed by the data words.  The chip ID registers are
+ * preloaded so PRDevice::Open() succeeds.
+ */
+class PRTransportMemory : public PRTransport
+{
+public:
+    PRTransportMemory();
+
+    PRResult Open();
+    void Close();
+    int Read(uint8_t *buffer, int maxBytes);
+    int Write(uint8_t *buffer, int bytes);
+    bool IsHardware() { return false; }
+
+protected:
+    void ProcessWord(uint32_t word);
+    void QueueWord(uint32_t word);
+
+    /** Stores one burst data word.  addr is {module select, address}. */
+    virtual void WriteRegister(uint32_t addr, uint32_t value);
+    /** Returns the word a read request for addr should be answered with. */
+    virtual uint32_t ReadRegister(uint32_t addr);
+
+    std::map<uint32_t, uint32_t> registers;
+    std::vector<uint8_t> readBytes;  /**< Response bytes not yet returned by Read(). */
+    size_t readOffset;
+
+    uint32_t partialWord;       /**< Bytes of a word split across Write() calls. */
+    int numPartialBytes;
+    uint32_t burstAddr;         /**< Register key for the next burst data word. */
+    uint32_t burstWordsLeft;
+};
+
+#endif /* PINPROC_PRTRANSPORTMEMORY_H */
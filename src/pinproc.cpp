@@ -34,6 +34,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include "PRDevice.h"
+#include "PRDMDEncoder.h"
+#include "PRDMDAnimation.h"
+#include "PRDMDFont.h"
+#include "PRDMDTiming.h"
+#include "PRSimulator.h"
 
 #if defined(_MSC_VER) && (_MSC_VER < 1400)
 #define vsnprintf _vsnprintf
@@ -72,7 +77,9 @@ void PRLogSetLevel(PRLogLevel level)
     logLevel = level;
 }
 
-char lastErrorText[MAX_TEXT];
+// Per thread so errors logged on a handle's I/O thread can't overwrite the
+// text the application is about to read.
+thread_local char lastErrorText[MAX_TEXT];
 
 void PRSetLastErrorText(const char *format, ...)
 {
@@ -92,7 +99,25 @@ const char *PRGetLastErrorText(void)
 /** Create a new P-ROC device handle.  Only one handle per device may be created. This handle must be destroyed with PRDelete() when it is no longer needed. */
 PRHandle PRCreate(PRMachineType machineType)
 {
-    PRDevice *device = PRDevice::Create(machineType);
+    PRCreateOptions options;
+    PRCreateOptionsInit(&options);
+    return PRCreateEx(machineType, &options);
+}
+/** Fills in the options PRCreate() uses. */
+void PRCreateOptionsInit(PRCreateOptions *options)
+{
+    memset(options, 0x00, sizeof(PRCreateOptions));
+    options->transportType = kPRTransportFTDI;
+    options->deviceIndex = 0;
+    options->simulatorChipID = P_ROC_CHIP_ID;
+    options->useIOThread = false;
+    options->eventQueueSize = kPRDefaultEventQueueSize;
+    options->requestedDataQueueSize = kPRDefaultRequestedDataQueueSize;
+}
+/** Create a new device handle using the given transport and options. */
+PRHandle PRCreateEx(PRMachineType machineType, PRCreateOptions *options)
+{
+    PRDevice *device = PRDevice::Create(machineType, options);
     if (device == NULL)
         return kPRHandleInvalid;
     else
@@ -137,6 +162,26 @@ PRResult PRReadData(PRHandle handle, uint32_t moduleSelect, uint32_t startingAdd
     return handleAsDevice->ReadDataRaw(moduleSelect, startingAddr, numReadWords, readBuffer);
 }
 
+PRResult PRReadDataTimeout(PRHandle handle, uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, uint32_t * readBuffer, uint32_t timeoutUs)
+{
+    return handleAsDevice->ReadDataRaw(moduleSelect, startingAddr, numReadWords, readBuffer, timeoutUs);
+}
+
+PRResult PRReadDataMulti(PRHandle handle, PRReadRequest * requests, int32_t numRequests)
+{
+    return handleAsDevice->ReadDataMulti(requests, numRequests);
+}
+
+PRResult PRReadDataAsync(PRHandle handle, uint32_t moduleSelect, uint32_t startingAddr, int32_t numReadWords, PRReadCallback callback, void * userData)
+{
+    return handleAsDevice->ReadDataAsync(moduleSelect, startingAddr, numReadWords, callback, userData);
+}
+
+int PRWaitForReads(PRHandle handle, uint32_t timeoutUs)
+{
+    return handleAsDevice->WaitForReads(timeoutUs);
+}
+
 // Events
 
 /** Get all of the available events that have been received. */
@@ -145,6 +190,26 @@ int PRGetEvents(PRHandle handle, PREvent *eventsOut, int maxEvents)
     return handleAsDevice->GetEvents(eventsOut, maxEvents);
 }
 
+int PRGetEventsEx(PRHandle handle, PREventEx *eventsOut, int maxEvents)
+{
+    return handleAsDevice->GetEventsEx(eventsOut, maxEvents);
+}
+
+int PRWaitForEvents(PRHandle handle, uint32_t timeoutUs)
+{
+    return handleAsDevice->WaitForEvents(timeoutUs);
+}
+
+int PRGetEventFD(PRHandle handle)
+{
+    return handleAsDevice->GetEventFD();
+}
+
+PRResult PRGetStats(PRHandle handle, PRStats *stats)
+{
+    return handleAsDevice->GetStats(stats);
+}
+
 // Manager
 PRResult PRManagerUpdateConfig(PRHandle handle, PRManagerConfig *managerConfig)
 {
@@ -543,10 +608,130 @@ int32_t PRDMDUpdateConfig(PRHandle handle, PRDMDConfig *dmdConfig)
 {
     return handleAsDevice->DMDUpdateConfig(dmdConfig);
 }
+PRResult PRDMDComputeTiming(PRDMDConfig *dmdConfig, uint32_t refreshHz, uint32_t fpgaClockHz, PRDMDTiming *timing)
+{
+    return PRDMDOptimizeTiming(dmdConfig, refreshHz, fpgaClockHz, timing);
+}
 PRResult PRDMDDraw(PRHandle handle, uint8_t * dots)
 {
     return handleAsDevice->DMDDraw(dots);
 }
+PRResult PRDMDSetFrameDiffing(PRHandle handle, bool_t enable)
+{
+    return handleAsDevice->DMDSetFrameDiffing(enable != 0);
+}
+PRResult PRDMDSetColorMap(PRHandle handle, const uint8_t * colorMap, int32_t numEntries)
+{
+    return handleAsDevice->DMDSetColorMap(colorMap, numEntries);
+}
+PRResult PRDMDDrawGrayscale(PRHandle handle, const uint8_t * pixels, uint32_t stride)
+{
+    return handleAsDevice->DMDDrawPixels(pixels, stride, true);
+}
+PRResult PRDMDDrawMapped(PRHandle handle, const uint8_t * pixels, uint32_t stride)
+{
+    return handleAsDevice->DMDDrawPixels(pixels, stride, false);
+}
+PRResult PRDMDEncodeFrame(const uint8_t * pixels, uint32_t stride, uint16_t numColumns, uint8_t numRows, uint8_t numSubFrames, const uint8_t * colorMap, uint8_t * dots)
+{
+    return PRDMDEncodePlanes(dots, pixels, stride, numColumns, numRows, numSubFrames, colorMap);
+}
+PRResult PRDMDQueueFrame(PRHandle handle, const uint8_t * dots, uint64_t displayTimeNs)
+{
+    return handleAsDevice->DMDQueueFrame(dots, displayTimeNs);
+}
+PRResult PRDMDQueueClear(PRHandle handle)
+{
+    return handleAsDevice->DMDQueueClear();
+}
+PRResult PRDMDQueueGetStatus(PRHandle handle, PRDMDQueueStatus * status)
+{
+    return handleAsDevice->DMDQueueGetStatus(status);
+}
+PRDMDAnimationHandle PRDMDAnimationOpen(const char * path)
+{
+    PRDMDAnimation *animation = PRDMDAnimation::Open(path);
+    if (animation == NULL)
+        return kPRDMDAnimationHandleInvalid;
+    else
+        return animation;
+}
+void PRDMDAnimationClose(PRDMDAnimationHandle animation)
+{
+    if (animation != kPRDMDAnimationHandleInvalid)
+        ((PRDMDAnimation *)animation)->Release();
+}
+PRResult PRDMDAnimationGetInfo(PRDMDAnimationHandle animation, PRDMDAnimationInfo * info)
+{
+    ((PRDMDAnimation *)animation)->GetInfo(info);
+    return kPRSuccess;
+}
+PRResult PRDMDPlayAnimation(PRHandle handle, PRDMDAnimationHandle animation, bool_t loop)
+{
+    return handleAsDevice->DMDPlayAnimation((PRDMDAnimation *)animation, loop);
+}
+PRResult PRDMDStopAnimation(PRHandle handle)
+{
+    return handleAsDevice->DMDStopAnimation();
+}
+int32_t PRDMDAnimationCurrentFrame(PRHandle handle)
+{
+    return handleAsDevice->DMDAnimationCurrentFrame();
+}
+int32_t PRDMDLayerCreate(PRHandle handle, uint16_t width, uint8_t height, PRDMDLayerMode mode)
+{
+    return handleAsDevice->GetDMDCompositor()->CreateLayer(width, height, mode);
+}
+PRResult PRDMDLayerSetPixels(PRHandle handle, int32_t layer, const uint8_t * pixels, uint32_t stride, uint8_t bitsPerPixel)
+{
+    return handleAsDevice->GetDMDCompositor()->SetPixels(layer, pixels, stride, bitsPerPixel);
+}
+PRResult PRDMDLayerSetAlpha(PRHandle handle, int32_t layer, const uint8_t * alpha, uint32_t stride)
+{
+    return handleAsDevice->GetDMDCompositor()->SetAlpha(layer, alpha, stride);
+}
+PRResult PRDMDLayerSetPosition(PRHandle handle, int32_t layer, int16_t x, int16_t y)
+{
+    return handleAsDevice->GetDMDCompositor()->SetPosition(layer, x, y);
+}
+PRResult PRDMDLayerSetVisible(PRHandle handle, int32_t layer, bool_t visible)
+{
+    return handleAsDevice->GetDMDCompositor()->SetVisible(layer, visible != 0);
+}
+PRResult PRDMDLayersRemove(PRHandle handle)
+{
+    handleAsDevice->GetDMDCompositor()->RemoveLayers();
+    return kPRSuccess;
+}
+PRResult PRDMDComposite(PRHandle handle)
+{
+    return handleAsDevice->DMDComposite();
+}
+PRDMDFontHandle PRDMDFontCreate(uint8_t height, uint8_t numSubFrames, uint8_t spacing)
+{
+    PRDMDFont *font = PRDMDFont::Create(height, numSubFrames, spacing);
+    if (font == NULL)
+        return kPRDMDFontHandleInvalid;
+    else
+        return font;
+}
+void PRDMDFontDelete(PRDMDFontHandle font)
+{
+    if (font != kPRDMDFontHandleInvalid)
+        delete (PRDMDFont *)font;
+}
+PRResult PRDMDFontAddGlyph(PRDMDFontHandle font, uint8_t character, const uint8_t * pixels, uint8_t width, uint32_t stride, const uint8_t * colorMap)
+{
+    return ((PRDMDFont *)font)->AddGlyph(character, pixels, width, stride, colorMap);
+}
+int32_t PRDMDFontDrawText(PRDMDFontHandle font, uint8_t * dots, uint16_t numColumns, uint8_t numRows, int32_t x, int32_t y, const char * text)
+{
+    return ((PRDMDFont *)font)->DrawText(dots, numColumns, numRows, x, y, text);
+}
+int32_t PRDMDFontTextWidth(PRDMDFontHandle font, const char * text)
+{
+    return ((PRDMDFont *)font)->TextWidth(text);
+}
 
 // JTAG
 
@@ -609,3 +794,96 @@ PRResult PRLEDRGBFadeColor(PRHandle handle, PRLEDRGB * pLED, uint32_t fadeColor)
 {
     return handleAsDevice->PRLEDRGBFadeColor(pLED, fadeColor);
 }
+
+PRResult PRLEDUpdateFrame(PRHandle handle, const PRLEDFrameEntry * entries, int32_t numEntries)
+{
+    return handleAsDevice->PRLEDUpdateFrame(entries, numEntries);
+}
+
+// Simulator
+
+static PRSimulator *HandleAsSimulator(PRHandle handle)
+{
+    PRSimulator *simulator = handleAsDevice->GetSimulator();
+    if (simulator == NULL)
+        PRSetLastErrorText("Handle was not created with kPRTransportSimulator");
+    return simulator;
+}
+
+PRResult PRSimulatorScheduleEvents(PRHandle handle, const PRSimulatorEvent *events, int numEvents)
+{
+    PRSimulator *simulator = HandleAsSimulator(handle);
+    if (simulator == NULL)
+        return kPRFailure;
+    simulator->ScheduleEvents(events, numEvents);
+    return kPRSuccess;
+}
+
+PRResult PRSimulatorAdvance(PRHandle handle, uint32_t microseconds)
+{
+    PRSimulator *simulator = HandleAsSimulator(handle);
+    if (simulator == NULL)
+        return kPRFailure;
+    simulator->Advance(microseconds);
+    return kPRSuccess;
+}
+
+PRResult PRSimulatorGetTime(PRHandle handle, uint64_t *time)
+{
+    PRSimulator *simulator = HandleAsSimulator(handle);
+    if (simulator == NULL)
+        return kPRFailure;
+    *time = simulator->GetTime();
+    return kPRSuccess;
+}
+
+PRResult PRSimulatorSetSwitch(PRHandle handle, uint16_t switchNum, bool_t open)
+{
+    PRSimulator *simulator = HandleAsSimulator(handle);
+    if (simulator == NULL)
+        return kPRFailure;
+    PRSimulatorEvent event;
+    event.time = simulator->GetTime();
+    event.type = open ? kPRSimulatorEventSwitchOpen : kPRSimulatorEventSwitchClosed;
+    event.number = switchNum;
+    event.value = 0;
+    simulator->ScheduleEvents(&event, 1);
+    simulator->Advance(0);
+    return kPRSuccess;
+}
+
+PRResult PRSimulatorGetDriverState(PRHandle handle, uint16_t driverNum, PRDriverState *driverState)
+{
+    PRSimulator *simulator = HandleAsSimulator(handle);
+    if (simulator == NULL)
+        return kPRFailure;
+    if (driverNum >= kPRSimulatorMaxDrivers)
+    {
+        PRSetLastErrorText("Driver number %d out of range", driverNum);
+        return kPRFailure;
+    }
+    simulator->GetDriverState(driverNum, driverState);
+    return kPRSuccess;
+}
+
+int PRSimulatorGetDMDFrame(PRHandle handle, uint8_t frameBuffer, uint32_t *words, int maxWords)
+{
+    PRSimulator *simulator = HandleAsSimulator(handle);
+    if (simulator == NULL)
+        return -1;
+    return simulator->GetDMDFrame(frameBuffer, words, maxWords);
+}
+
+PRResult PRSimulatorGetLEDState(PRHandle handle, uint8_t boardAddr, uint8_t LEDIndex, PRSimulatorLEDState *state)
+{
+    PRSimulator *simulator = HandleAsSimulator(handle);
+    if (simulator == NULL)
+        return kPRFailure;
+    if (boardAddr >= kPRSimulatorMaxLEDBoards)
+    {
+        PRSetLastErrorText("PD-LED board address %d out of range", boardAddr);
+        return kPRFailure;
+    }
+    simulator->GetLEDState(boardAddr, LEDIndex, state);
+    return kPRSuccess;
+}
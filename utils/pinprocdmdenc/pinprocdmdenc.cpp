@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2009 Gerry Stellenberg, Adam Preble
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ *  pinprocdmdenc.cpp
+ *  libpinproc
+ *
+ *  Converts a sequence of frames into a DMD animation file for
+ *  PRDMDAnimationOpen() and PRDMDPlayAnimation().  Frames are binary PGM or
+ *  PPM images (ffmpeg -i clip.gif frame%04d.pgm produces them) the size of
+ *  the display.  They are decoded and packed into subframe bitplanes by a
+ *  pool of threads, each taking the next frame as it finishes the last.
+ *  Identical consecutive frames share one index entry with a repeat count.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pinproc.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options
+{
+    int numColumns;
+    int numRows;
+    int numSubFrames;
+    int numThreads;
+    int frameEvents;  // Frame events each input frame is shown for.
+    bool dither;
+    const char *outPath;
+};
+
+struct Frame
+{
+    std::vector<uint8_t> dots;
+    std::string error;
+};
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-c columns] [-r rows] [-s subframes] [-j threads] [-e events] [-d] -o out.pdma frame.pgm...\n", name);
+    fprintf(stderr, "  -c  Display width in dots, a multiple of 8 up to %d (default 128).\n", kPRDMDMaxEncodeColumns);
+    fprintf(stderr, "  -r  Display height in dots (default 32); columns x rows must be a multiple of 32.\n");
+    fprintf(stderr, "  -s  Subframes, i.e. bits of brightness (default 4).\n");
+    fprintf(stderr, "  -j  Encoder threads (default: one per CPU).\n");
+    fprintf(stderr, "  -e  Frame events each input frame is shown for (default 1).\n");
+    fprintf(stderr, "  -d  Ordered (Bayer) dithering down to the subframe depth.\n");
+    fprintf(stderr, "Frames are binary PGM (P5) or PPM (P6) images of exactly columns x rows pixels.\n");
+}
+
+// Reads the next header field of a PNM file, skipping whitespace and comments.
+static bool ReadPNMField(FILE *file, int *value)
+{
+    int c = fgetc(file);
+    while (c == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+    {
+        if (c == '#')
+            while (c != '\n' && c != EOF)
+                c = fgetc(file);
+        c = fgetc(file);
+    }
+    if (c < '0' || c > '9')
+        return false;
+    *value = 0;
+    while (c >= '0' && c <= '9')
+    {
+        *value = *value * 10 + (c - '0');
+        c = fgetc(file);
+    }
+    // Exactly one whitespace character separates the header from the pixels.
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Loads a PGM or PPM file as 8-bit gray pixels, converting color to luma.
+static bool LoadFrame(const char *path, int numColumns, int numRows, std::vector<uint8_t> *gray, std::string *error)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        *error = "can't open file";
+        return false;
+    }
+    char magic[2];
+    int width, height, maxValue;
+    bool ok = fread(magic, 1, 2, file) == 2 && magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6') &&
+              ReadPNMField(file, &width) && ReadPNMField(file, &height) && ReadPNMField(file, &maxValue);
+    if (!ok || maxValue < 1 || maxValue > 255)
+    {
+        *error = "not an 8-bit binary PGM or PPM file";
+        fclose(file);
+        return false;
+    }
+    if (width != numColumns || height != numRows)
+    {
+        char text[80];
+        snprintf(text, sizeof(text), "image is %dx%d, not %dx%d", width, height, numColumns, numRows);
+        *error = text;
+        fclose(file);
+        return false;
+    }
+
+    int channels = magic[1] == '6' ? 3 : 1;
+    std::vector<uint8_t> raw(numColumns * numRows * channels);
+    ok = fread(&raw[0], 1, raw.size(), file) == raw.size();
+    fclose(file);
+    if (!ok)
+    {
+        *error = "file is truncated";
+        return false;
+    }
+
+    gray->resize(numColumns * numRows);
+    for (int i = 0; i < numColumns * numRows; i++)
+    {
+        int value = raw[i * channels];
+        if (channels == 3)
+            value = (77 * raw[i * 3] + 150 * raw[i * 3 + 1] + 29 * raw[i * 3 + 2]) >> 8;
+        (*gray)[i] = (uint8_t)(maxValue == 255 ? value : value * 255 / maxValue);
+    }
+    return true;
+}
+
+// Quantizes gray pixels to numSubFrames bits in place, spreading the error
+// over a 4x4 Bayer pattern.
+static void Dither(uint8_t *pixels, int numColumns, int numRows, int numSubFrames)
+{
+    static const int bayer[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+    int maxLevel = (1 << numSubFrames) - 1;
+    for (int y = 0; y < numRows; y++)
+    {
+        for (int x = 0; x < numColumns; x++)
+        {
+            uint8_t *p = &pixels[y * numColumns + x];
+            // Scaled by 16 * 255: the level, plus a threshold in [0, 1).
+            int scaled = *p * maxLevel * 16 + bayer[y & 3][x & 3] * 255 + 127;
+            *p = (uint8_t)(scaled / (16 * 255));
+        }
+    }
+}
+
+static void EncodeFrames(const Options *options, char **paths, std::vector<Frame> *frames, std::atomic<int> *next)
+{
+    int frameBytes = options->numColumns * options->numRows / 8 * options->numSubFrames;
+    uint8_t colorMap[256];
+    for (int i = 0; i < 256; i++)
+        colorMap[i] = (uint8_t)(i >> (8 - options->numSubFrames));
+    std::vector<uint8_t> gray;
+
+    int i;
+    while ((i = (*next)++) < (int)frames->size())
+    {
+        Frame *frame = &(*frames)[i];
+        if (!LoadFrame(paths[i], options->numColumns, options->numRows, &gray, &frame->error))
+            continue;
+        if (options->dither)
+            Dither(&gray[0], options->numColumns, options->numRows, options->numSubFrames);
+        // Dithered pixels already hold subframe bits; the rest keep their top bits.
+        frame->dots.resize(frameBytes);
+        if (PRDMDEncodeFrame(&gray[0], options->numColumns, options->numColumns, options->numRows, options->numSubFrames,
+                             options->dither ? NULL : colorMap, &frame->dots[0]) != kPRSuccess)
+            frame->error = "can't encode frame";
+    }
+}
+
+static void PutLE(std::vector<uint8_t> *out, uint64_t value, int numBytes)
+{
+    for (int i = 0; i < numBytes; i++)
+        out->push_back((uint8_t)(value >> (8 * i)));
+}
+
+// Writes the animation in the layout PRDMDAnimationOpen() documents.  Runs
+// of identical frames become one index entry; frames that appear again
+// later are stored again, which keeps the writer single-pass.
+static bool WriteAnimation(const Options *options, const std::vector<Frame> &frames, size_t *numEntries, size_t *fileBytes)
+{
+    uint32_t frameBytes = options->numColumns * options->numRows / 8 * options->numSubFrames;
+    std::vector<size_t> first;   // Frame that starts each run.
+    std::vector<uint32_t> repeats;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        // Runs too long for the 32-bit repeat field start a new entry.
+        if (!first.empty() && frames[i].dots == frames[first.back()].dots &&
+            repeats.back() <= 0xFFFFFFFF - (uint32_t)options->frameEvents)
+        {
+            repeats.back() += options->frameEvents;
+            continue;
+        }
+        first.push_back(i);
+        repeats.push_back(options->frameEvents);
+    }
+
+    std::vector<uint8_t> header;
+    header.insert(header.end(), { 'P', 'D', 'M', 'A' });
+    PutLE(&header, 1, 2);
+    PutLE(&header, options->numColumns, 2);
+    PutLE(&header, options->numRows, 1);
+    PutLE(&header, options->numSubFrames, 1);
+    PutLE(&header, 0, 2);
+    PutLE(&header, first.size(), 4);
+    PutLE(&header, frameBytes, 4);
+    PutLE(&header, 0, 4);
+    // The header and index entries are multiples of 4 bytes, as are frames,
+    // so every frame starts word aligned.
+    uint64_t offset = header.size() + first.size() * 16;
+    for (size_t i = 0; i < first.size(); i++, offset += frameBytes)
+    {
+        PutLE(&header, offset, 8);
+        PutLE(&header, repeats[i], 4);
+        PutLE(&header, 0, 4);
+    }
+
+    FILE *file = fopen(options->outPath, "wb");
+    if (file == NULL)
+        return false;
+    bool ok = fwrite(&header[0], 1, header.size(), file) == header.size();
+    for (size_t i = 0; ok && i < first.size(); i++)
+        ok = fwrite(&frames[first[i]].dots[0], 1, frameBytes, file) == frameBytes;
+    ok = fclose(file) == 0 && ok;
+    *numEntries = first.size();
+    *fileBytes = offset;
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    Options options = { 128, 32, 4, (int)std::thread::hardware_concurrency(), 1, false, NULL };
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            options.numColumns = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            options.numRows = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            options.numSubFrames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            options.numThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            options.frameEvents = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-d") == 0)
+            options.dither = true;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            options.outPath = argv[++i];
+        else
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    // Rows pack 8 dots to a byte, and subframes are whole words like the
+    // dot table, so every frame in the file starts word aligned.
+    if (options.outPath == NULL || i == argc ||
+        options.numColumns <= 0 || options.numColumns > kPRDMDMaxEncodeColumns || options.numColumns % 8 != 0 ||
+        options.numRows <= 0 || options.numRows > 255 || options.numColumns * options.numRows % 32 != 0 ||
+        options.numSubFrames < 1 || options.numSubFrames > 8 || options.frameEvents < 1)
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+    if (options.numThreads < 1)
+        options.numThreads = 1;
+
+    char **paths = argv + i;
+    std::vector<Frame> frames(argc - i);
+    std::atomic<int> next(0);
+    int numThreads = std::min<int>(options.numThreads, (int)frames.size());
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; t++)
+        threads.push_back(std::thread(EncodeFrames, &options, paths, &frames, &next));
+    EncodeFrames(&options, paths, &frames, &next);
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    int numErrors = 0;
+    for (size_t f = 0; f < frames.size(); f++)
+    {
+        if (!frames[f].error.empty())
+        {
+            fprintf(stderr, "%s: %s\n", paths[f], frames[f].error.c_str());
+            numErrors++;
+        }
+    }
+    if (numErrors > 0)
+        return 1;
+
+    size_t numEntries, fileBytes;
+    if (!WriteAnimation(&options, frames, &numEntries, &fileBytes))
+    {
+        fprintf(stderr, "Error writing %s\n", options.outPath);
+        return 1;
+    }
+
+    double megapixels = (double)frames.size() * options.numColumns * options.numRows / 1e6;
+    printf("Encoded %zu frames (%dx%d, %d subframes%s) on %d threads in %.3f s: %.0f frames/s, %.1f Mpixels/s\n",
+           frames.size(), options.numColumns, options.numRows, options.numSubFrames, options.dither ? ", dithered" : "",
+           numThreads, seconds, frames.size() / seconds, megapixels / seconds);
+    printf("Wrote %s: %zu index entries, %zu bytes\n", options.outPath, numEntries, fileBytes);
+    return 0;
+}
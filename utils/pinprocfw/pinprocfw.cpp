@@ -829,10 +829,10 @@ int xsvfGotoTapState( unsigned char*   pucTapState,
 *               plvTdi          - ptr to lenval for TDI data.
 *               plvTdoCaptured  - ptr to lenval for storing captured TDO data.
 *               iExitShift      - 1=exit at end of shift; 0=stay in Shift-DR.
-* Returns:      void.
+* Returns:      int             - 0 = success; otherwise error.
 *****************************************************************************/
 
-void xsvfShiftOnly( long    lNumBits,
+int xsvfShiftOnly( long    lNumBits,
                     lenVal* plvTdi,
                     lenVal* plvTdoCaptured,
                     int     iExitShift )
@@ -848,7 +848,6 @@ void xsvfShiftOnly( long    lNumBits,
     uint32_t        tempWord1 = 0, tempWord2 = 0; 
     int             numBytes, numWords;
     uint32_t        addr;
-    PRJTAGStatus    jtagStatus;
 
     /* assert( ( ( lNumBits + 7 ) / 8 ) == plvTdi->len ); */
 
@@ -897,22 +896,34 @@ void xsvfShiftOnly( long    lNumBits,
     PRJTAGShiftTDOData(proc, (uint16_t) lNumBits, (bool_t) iExitShift);
     //if (numBytes > 40) sleep(1);
 
-    jtagStatus.commandComplete = 0;
-    while (!(jtagStatus.commandComplete))
+    // Read the TDI memory back in the same round trip as each status poll.
+    // The device answers in order, so the copy that comes back with the
+    // first "done" status already holds the shifted data.
+    uint32_t statusWord = 0;
+    PRReadRequest reads[2] = {
+        { P_ROC_BUS_JTAG_SELECT, P_ROC_JTAG_STATUS_REG_BASE_ADDR, 1, &statusWord },
+        { P_ROC_BUS_JTAG_SELECT, (uint32_t)(P_ROC_JTAG_TDI_MEMORY_BASE_ADDR + tableOffset), numWords, dataBuffer },
+    };
+    do
     {
         //printf (".");
-        PRJTAGGetStatus( proc, &jtagStatus );
+        if ( PRReadDataMulti( proc, reads, (pucTdo && numWords > 0) ? 2 : 1 ) != kPRSuccess )
+        {
+            fprintf(stderr, "\nERROR: JTAG status read failed: %s\n", PRGetLastErrorText());
+            return( XSVF_ERROR_UNKNOWN );
+        }
     }
+    while (!(statusWord >> P_ROC_JTAG_STATUS_DONE_SHIFT));
        
     if (pucTdo) {
-        PRJTAGReadTDIMemory( proc, tableOffset, numWords, dataBuffer );
-  
         // Move returning words into pucTdo
         for (i=0; i<numBytes; i++) 
         {
             (*(--pucTdo)) = (unsigned char)( (dataBuffer[(numWords-1)-(i/4)] >> 8*(i%4)) & 0xff ); 
         }
     }
+
+    return( XSVF_ERROR_NONE );
 }
 
 
@@ -990,7 +1001,11 @@ int xsvfShift( unsigned char*   pucTapState,
             xsvfGotoTapState( pucTapState, ucStartState );
 
             /* Shift TDI and capture TDO */
-            xsvfShiftOnly( lNumBits, plvTdi, plvTdoCaptured, iExitShift );
+            iErrorCode  = xsvfShiftOnly( lNumBits, plvTdi, plvTdoCaptured, iExitShift );
+            if ( iErrorCode != XSVF_ERROR_NONE )
+            {
+                return( iErrorCode );
+            }
 
             if ( plvTdoExpected )
             {